@@ -0,0 +1,244 @@
+// noavrd@gmail.com
+
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <vector>
+#include <new>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+
+using namespace std;
+
+/**
+ * A bump allocator that owns the nodes of a tree
+ *
+ * Nodes are placed one after the other in big contiguous chunks, and all of them are freed together.
+ * There is no way to free a single node, which is fine for trees because nodes are never removed.
+ *
+ * @tparam N The type of the allocated objects (the tree node type)
+ */
+template <typename N>
+class NodeArena {
+private:
+    // Each chunk and how many objects it can hold
+    vector<pair<N *, size_t>> chunks;
+    // Number of objects used in the last chunk
+    size_t used;
+    // Total number of objects allocated
+    size_t count;
+    // Capacity of the next chunk, grows until it reaches MAX_CHUNK_SIZE
+    size_t nextChunkSize;
+
+    static constexpr size_t MIN_CHUNK_SIZE = 64;
+    static constexpr size_t MAX_CHUNK_SIZE = 64 * 1024;
+
+    // Get a new chunk that can hold at least nextChunkSize objects
+    void add_chunk() {
+        N *memory = static_cast<N *>(::operator new(nextChunkSize * sizeof(N)));
+
+        try {
+            chunks.emplace_back(memory, nextChunkSize);
+        } catch (...) {
+            ::operator delete(memory);
+            throw;
+        }
+
+        used = 0;
+
+        if (nextChunkSize < MAX_CHUNK_SIZE) {
+            nextChunkSize *= 2;
+        }
+    }
+
+public:
+    NodeArena() : used(0), count(0), nextChunkSize(MIN_CHUNK_SIZE) {}
+
+    NodeArena(const NodeArena &) = delete;
+    NodeArena &operator=(const NodeArena &) = delete;
+
+    NodeArena(NodeArena &&other) noexcept
+        : chunks(move(other.chunks)), used(other.used), count(other.count), nextChunkSize(other.nextChunkSize) {
+        other.chunks.clear();
+        other.used = 0;
+        other.count = 0;
+        other.nextChunkSize = MIN_CHUNK_SIZE;
+    }
+
+    NodeArena &operator=(NodeArena &&other) noexcept {
+        if (this != &other) {
+            release();
+            swap(chunks, other.chunks);
+            swap(used, other.used);
+            swap(count, other.count);
+            swap(nextChunkSize, other.nextChunkSize);
+        }
+        return *this;
+    }
+
+    ~NodeArena() {
+        release();
+    }
+
+    /**
+     * Construct a new object in the arena
+     *
+     * @param args The arguments for the object constructor
+     * @return Pointer to the new object, owned by the arena
+     */
+    template <typename... Args>
+    N *allocate(Args &&...args) {
+        if (chunks.empty() || used == chunks.back().second) {
+            add_chunk();
+        }
+
+        N *object = new (chunks.back().first + used) N(forward<Args>(args)...);
+        ++used;
+        ++count;
+        return object;
+    }
+
+    /**
+     * Destroy all the objects and free all the chunks in one call
+     *
+     * Objects with a trivial destructor are not visited at all
+     */
+    void release() {
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            if constexpr (!is_trivially_destructible<N>::value) {
+                size_t objects = (i + 1 == chunks.size()) ? used : chunks[i].second;
+
+                for (size_t j = 0; j < objects; ++j) {
+                    chunks[i].first[j].~N();
+                }
+            }
+
+            ::operator delete(chunks[i].first);
+        }
+
+        chunks.clear();
+        used = 0;
+        count = 0;
+        nextChunkSize = MIN_CHUNK_SIZE;
+    }
+
+    /**
+     * Destroy the objects that were allocated after the first ones, and free the chunks they leave empty
+     *
+     * @param kept The number of objects to keep
+     */
+    void release_after(size_t kept) {
+        while (count > kept) {
+            size_t removed = min(used, count - kept);
+
+            if constexpr (!is_trivially_destructible<N>::value) {
+                for (size_t j = used - removed; j < used; ++j) {
+                    chunks.back().first[j].~N();
+                }
+            }
+
+            used -= removed;
+            count -= removed;
+
+            // Every chunk before the last one is full
+            if (used == 0 && count > kept) {
+                ::operator delete(chunks.back().first);
+                chunks.pop_back();
+                used = chunks.back().second;
+            }
+        }
+    }
+
+    /**
+     * @return The number of objects in the arena
+     */
+    size_t size() const {
+        return count;
+    }
+};
+
+/**
+ * An allocator that creates every node with its own new, like the old code did,
+ * but still owns them and deletes all of them together
+ *
+ * @tparam N The type of the allocated objects (the tree node type)
+ */
+template <typename N>
+class HeapAllocator {
+private:
+    vector<N *> objects;
+
+public:
+    HeapAllocator() = default;
+
+    HeapAllocator(const HeapAllocator &) = delete;
+    HeapAllocator &operator=(const HeapAllocator &) = delete;
+
+    HeapAllocator(HeapAllocator &&other) noexcept : objects(move(other.objects)) {
+        other.objects.clear();
+    }
+
+    HeapAllocator &operator=(HeapAllocator &&other) noexcept {
+        if (this != &other) {
+            release();
+            swap(objects, other.objects);
+        }
+        return *this;
+    }
+
+    ~HeapAllocator() {
+        release();
+    }
+
+    /**
+     * Construct a new object on the heap
+     *
+     * @param args The arguments for the object constructor
+     * @return Pointer to the new object, owned by the allocator
+     */
+    template <typename... Args>
+    N *allocate(Args &&...args) {
+        N *object = new N(forward<Args>(args)...);
+
+        try {
+            objects.push_back(object);
+        } catch (...) {
+            delete object;
+            throw;
+        }
+
+        return object;
+    }
+
+    /**
+     * Delete all the objects
+     */
+    void release() {
+        for (N *object : objects) {
+            delete object;
+        }
+        objects.clear();
+    }
+
+    /**
+     * Delete the objects that were allocated after the first ones
+     *
+     * @param kept The number of objects to keep
+     */
+    void release_after(size_t kept) {
+        while (objects.size() > kept) {
+            delete objects.back();
+            objects.pop_back();
+        }
+    }
+
+    /**
+     * @return The number of objects owned by the allocator
+     */
+    size_t size() const {
+        return objects.size();
+    }
+};
+
+#endif // ARENA_HPP
@@ -0,0 +1,1006 @@
+// noavrd@gmail.com
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <sstream>
+#include <fstream>
+#include <memory>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "tree.hpp"
+#include "tree_file.hpp"
+#include "parallel.hpp"
+#include "complex_array.hpp"
+#include "tree_csv.hpp"
+#include "traversal_writer.hpp"
+#include "tree_snapshot.hpp"
+#include "tree_layout.hpp"
+#include "layout_index.hpp"
+
+using namespace std;
+
+/**
+ * Measure how long a function takes, the best time of a few runs
+ * 
+ * @param run The function to measure
+ * @param repeats The number of runs
+ * @return The best running time in milliseconds
+ */
+template <typename F>
+double time_ms(F &&run, int repeats = 3) {
+    double best = 0;
+
+    for (int i = 0; i < repeats; ++i) {
+        auto start = chrono::steady_clock::now();
+        run();
+        auto end = chrono::steady_clock::now();
+
+        double ms = chrono::duration<double, milli>(end - start).count();
+        if (i == 0 || ms < best) {
+            best = ms;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * Print one benchmark result line
+ * 
+ * @param name The benchmark name
+ * @param ms The running time in milliseconds
+ */
+void report(const string &name, double ms) {
+    cout << left << setw(48) << name << right << setw(12) << fixed << setprecision(2) << ms << " ms" << endl;
+}
+
+/**
+ * Print one throughput result line
+ * 
+ * @param name The benchmark name
+ * @param ms The running time in milliseconds
+ * @param bytes The number of bytes processed
+ */
+void report_throughput(const string &name, double ms, size_t bytes) {
+    cout << left << setw(48) << name << right << setw(12) << fixed << setprecision(2) << ms << " ms"
+         << setw(12) << bytes / (ms * 1000.0) << " MB/s" << endl;
+}
+
+/**
+ * Make the parent index array of a random tree where every node has at most k children
+ * 
+ * @param nodes The number of nodes
+ * @param k The maximum number of children
+ * @param seed The random seed
+ * @return The parent of each node, -1 for the root
+ */
+vector<long> random_parents(size_t nodes, size_t k, unsigned seed) {
+    mt19937_64 random(seed);
+    vector<long> parents(nodes, -1);
+    vector<size_t> childCounts(nodes, 0);
+    vector<long> open; // Nodes that can still get children
+
+    for (size_t i = 0; i < nodes; ++i) {
+        if (i > 0) {
+            size_t slot = random() % open.size();
+            long parent = open[slot];
+            parents[i] = parent;
+
+            if (++childCounts[parent] == k) {
+                open[slot] = open.back();
+                open.pop_back();
+            }
+        }
+
+        open.push_back(static_cast<long>(i));
+    }
+
+    return parents;
+}
+
+/**
+ * Compare the iterators with the for_each traversals on the same tree
+ * 
+ * @param tree The tree to traverse
+ * @param name The tree name for the report
+ */
+template <typename TreeType>
+void bench_traversals(const TreeType &tree, const string &name) {
+    using NodeType = typename TreeType::NodeType;
+    long long sum = 0;
+
+    report(name + " pre-order iterator", time_ms([&] {
+        for (auto it = tree.begin_pre_order(); it != tree.end_pre_order(); ++it) sum += it->get_value();
+    }));
+    report(name + " for_each_pre_order", time_ms([&] {
+        tree.for_each_pre_order([&](NodeType &node) { sum += node.get_value(); });
+    }));
+
+    report(name + " post-order iterator", time_ms([&] {
+        for (auto it = tree.begin_post_order(); it != tree.end_post_order(); ++it) sum += it->get_value();
+    }));
+    report(name + " for_each_post_order", time_ms([&] {
+        tree.for_each_post_order([&](NodeType &node) { sum += node.get_value(); });
+    }));
+
+    report(name + " in-order iterator", time_ms([&] {
+        for (auto it = tree.begin_in_order(); it != tree.end_in_order(); ++it) sum += it->get_value();
+    }));
+    report(name + " for_each_in_order", time_ms([&] {
+        tree.for_each_in_order([&](NodeType &node) { sum += node.get_value(); });
+    }));
+
+    report(name + " BFS iterator", time_ms([&] {
+        for (auto it = tree.begin_bfs_scan(); it != tree.end_bfs_scan(); ++it) sum += it->get_value();
+    }));
+    report(name + " for_each_bfs", time_ms([&] {
+        tree.for_each_bfs([&](NodeType &node) { sum += node.get_value(); });
+    }));
+
+    // Print the sum so the traversals are not optimized away
+    cout << "(checksum " << sum << ")" << endl;
+}
+
+/**
+ * Build a random int tree
+ * 
+ * @param tree The tree to build
+ * @param nodes The number of nodes
+ * @param k The maximum number of children
+ */
+template <typename TreeType>
+void build_random_tree(TreeType &tree, size_t nodes, size_t k) {
+    vector<int> values(nodes);
+    for (size_t i = 0; i < nodes; ++i) {
+        values[i] = static_cast<int>(i);
+    }
+
+    tree.build_from_parents(values, random_parents(nodes, k, 42));
+}
+
+/**
+ * The thread counts to measure the parallel code with
+ * 
+ * @return 1, 2, 4, ... threads, and the number of cores
+ */
+vector<size_t> thread_counts() {
+    vector<size_t> threadCounts;
+    for (size_t threads = 1; threads < default_thread_count(); threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(default_thread_count());
+
+    return threadCounts;
+}
+
+/**
+ * Measure parallel_for_each from 1 thread up to the number of cores
+ * 
+ * @param tree The tree to traverse
+ * @param nodes The number of nodes
+ * @param name The tree name for the report
+ */
+template <typename TreeType>
+void bench_parallel(const TreeType &tree, size_t nodes, const string &name) {
+    using NodeType = typename TreeType::NodeType;
+    vector<long long> results(nodes); // One result per node (the values are the node indexes)
+
+    report(name + " for_each_post_order subtree sizes", time_ms([&] {
+        tree.for_each_post_order([&](NodeType &node) {
+            long long size = 1;
+            for (auto child : node.get_children()) size += results[child->get_value()];
+            results[node.get_value()] = size;
+        });
+    }));
+
+    for (size_t threads : thread_counts()) {
+        report(name + " parallel unordered, " + to_string(threads) + " threads", time_ms([&] {
+            parallel_for_each(tree, [&](NodeType &node) {
+                results[node.get_value()] = node.get_value() * 31 + static_cast<long long>(node.get_children().size());
+            }, ParallelOrder::unordered, threads);
+        }));
+
+        report(name + " parallel post-order, " + to_string(threads) + " threads", time_ms([&] {
+            parallel_for_each(tree, [&](NodeType &node) {
+                long long size = 1;
+                for (auto child : node.get_children()) size += results[child->get_value()];
+                results[node.get_value()] = size;
+            }, ParallelOrder::post_order, threads);
+        }));
+    }
+
+    // Print the root result so the traversals are not optimized away
+    cout << "(subtree size of the root " << results[0] << ")" << endl;
+}
+
+/**
+ * The old myHeap, kept to compare with: it copied the children of every node and did one swap pass per node,
+ * so it was not a full sift-down
+ * 
+ * @param node The root of the subtree
+ */
+template <typename NodeType>
+void legacy_heap(NodeType *node) {
+    if (!node) {
+        return;
+    }
+
+    auto children = node->get_children();
+    vector<NodeType *> copied(children.begin(), children.end());
+
+    for (auto *child : copied) {
+        legacy_heap(child);
+    }
+
+    for (auto *child : copied) {
+        if (child && node->get_value() > child->get_value()) {
+            node->swap_value(*child);
+        }
+    }
+}
+
+/**
+ * Compare the old myHeap with the bottom-up one, from 1 thread up to the number of cores
+ * 
+ * @param nodes The number of nodes
+ * @param k The maximum number of children
+ */
+void bench_heap(size_t nodes, size_t k) {
+    vector<int> values(nodes);
+    mt19937 random(7);
+    for (auto &value : values) {
+        value = static_cast<int>(random());
+    }
+    vector<long> parents = random_parents(nodes, k, 42);
+    string name = to_string(k) + "-ary";
+
+    // Every run needs an unsorted tree, so the build is timed too, and reported alone to subtract it
+    report(name + " build only", time_ms([&] {
+        Tree<int> tree(k);
+        tree.build_from_parents(values, parents);
+    }));
+    report(name + " build + legacy myHeap", time_ms([&] {
+        Tree<int> tree(k);
+        tree.build_from_parents(values, parents);
+        legacy_heap(tree.get_root());
+    }));
+
+    for (size_t threads : thread_counts()) {
+        report(name + " build + myHeap, " + to_string(threads) + " threads", time_ms([&] {
+            Tree<int> tree(k);
+            tree.build_from_parents(values, parents);
+            tree.myHeap(threads);
+        }));
+    }
+
+    // A stateless order costs the same as the default one, a function object that is not inlined does not
+    report(name + " build + myHeap, by_key(identity)", time_ms([&] {
+        Tree<int> tree(k);
+        tree.build_from_parents(values, parents);
+        tree.myHeap(1, by_key([](int value) { return value; }));
+    }));
+    report(name + " build + myHeap, std::function order", time_ms([&] {
+        Tree<int> tree(k);
+        tree.build_from_parents(values, parents);
+        tree.myHeap(1, function<bool(int, int)>([](int a, int b) { return a < b; }));
+    }));
+
+    // The first 10 values in heap order, before and after the tree is heap-ordered
+    Tree<int> tree(k);
+    tree.build_from_parents(values, parents);
+    long long sum = 0;
+
+    auto first_ten = [&] {
+        int taken = 0;
+        for (auto it = tree.begin_heap(); it != tree.end_heap() && taken < 10; ++it, ++taken) sum += it->get_value();
+    };
+
+    report(name + " first 10 of heap iterator", time_ms(first_ten));
+    tree.myHeap();
+    report(name + " first 10 of heap iterator, heap-ordered", time_ms(first_ten));
+
+    cout << "(checksum " << sum << ")" << endl;
+}
+
+/**
+ * Compare top_k and kth with taking the first k values of the heap iterator, for k much smaller than N
+ * 
+ * @param nodes The number of nodes
+ */
+void bench_top_k(size_t nodes) {
+    vector<int> values(nodes);
+    mt19937 random(7);
+    for (auto &value : values) {
+        value = static_cast<int>(random());
+    }
+
+    Tree<int> tree(3);
+    tree.build_from_parents(values, random_parents(nodes, 3, 42));
+    long long sum = 0;
+
+    for (size_t k : {10, 100, 1000, 10000}) {
+        string name = "k = " + to_string(k);
+
+        report(name + " heap iterator", time_ms([&] {
+            size_t taken = 0;
+            for (auto it = tree.begin_heap(); it != tree.end_heap() && taken < k; ++it, ++taken) sum += it->get_value();
+        }));
+        report(name + " top_k", time_ms([&] {
+            for (int value : tree.top_k(k)) sum += value;
+        }));
+        report(name + " top_k, biggest first", time_ms([&] {
+            for (int value : tree.top_k(k, [](int a, int b) { return a > b; })) sum += value;
+        }));
+        report(name + " kth", time_ms([&] {
+            sum += tree.kth(k);
+        }));
+    }
+
+    cout << "(checksum " << sum << ")" << endl;
+}
+
+/**
+ * Compare the complex array kernels with each other and with a loop over Complex values
+ * 
+ * @param count The number of complex numbers
+ */
+void bench_complex_kernels(size_t count) {
+    mt19937 random(7);
+    uniform_real_distribution<double> part(-1000, 1000);
+
+    vector<Complex> values;
+    for (size_t i = 0; i < count; ++i) {
+        values.push_back(Complex(part(random), part(random)));
+    }
+
+    ComplexArray a(values), b(values.rbegin(), values.rend()), out;
+    vector<double> magnitudes;
+    vector<uint8_t> greater;
+    size_t bigger = 0;
+
+    report("vector<Complex> operator>", time_ms([&] {
+        for (size_t i = 0; i < count; ++i) bigger += values[i] > values[count - 1 - i];
+    }));
+
+    for (ComplexKernel kernel : {ComplexKernel::scalar, ComplexKernel::sse2, ComplexKernel::avx2}) {
+        if (!complex_kernel_supported(kernel)) {
+            continue;
+        }
+
+        string name = kernel == ComplexKernel::scalar ? "scalar" : kernel == ComplexKernel::sse2 ? "sse2" : "avx2";
+
+        report(name + " add", time_ms([&] { complex_add(a, b, out, kernel); }));
+        report(name + " multiply", time_ms([&] { complex_multiply(a, b, out, kernel); }));
+        report(name + " magnitude", time_ms([&] { complex_magnitude(a, magnitudes, kernel); }));
+        report(name + " greater", time_ms([&] {
+            complex_greater(a, b, greater, kernel);
+            bigger += greater[0];
+        }));
+    }
+
+    cout << "(checksum " << bigger + static_cast<size_t>(out[0].get_real() + magnitudes[0]) << ")" << endl;
+}
+
+/**
+ * Compare building a tree from scratch with saving it and loading it back from a tree file
+ * 
+ * @param nodes The number of nodes
+ */
+void bench_tree_file(size_t nodes) {
+    const string path = "bench_tree.bin";
+    vector<int> values(nodes);
+    for (size_t i = 0; i < nodes; ++i) {
+        values[i] = static_cast<int>(i);
+    }
+    vector<long> parents = random_parents(nodes, 3, 42);
+
+    Tree<int> tree(3);
+    report("build_from_parents", time_ms([&] {
+        Tree<int> built(3);
+        built.build_from_parents(values, parents);
+    }));
+
+    tree.build_from_parents(values, parents);
+    report("save", time_ms([&] { tree.save(path); }));
+
+    long long sum = 0;
+    report("load_mmap (open only)", time_ms([&] {
+        MappedTree<int> mapped = Tree<int>::load_mmap(path);
+        sum += mapped.size();
+    }));
+    report("load_mmap + verify", time_ms([&] {
+        MappedTree<int> mapped = Tree<int>::load_mmap(path, true);
+        sum += mapped.size();
+    }));
+    report("load_mmap + pre-order scan", time_ms([&] {
+        MappedTree<int> mapped = Tree<int>::load_mmap(path);
+        for (int value : mapped.pre_order()) sum += value;
+    }));
+    report("load (rebuild a mutable tree)", time_ms([&] {
+        Tree<int> loaded(3);
+        loaded.load(path);
+    }));
+
+    remove(path.c_str());
+    cout << "(checksum " << sum << ")" << endl;
+}
+
+/**
+ * Measure the CSV loader on the edge list of a random tree
+ * 
+ * @param nodes The number of nodes
+ * @param name The value type name for the report
+ * @param value_text Makes the value column(s) of a node
+ */
+template <typename T, typename F>
+void bench_csv_type(size_t nodes, const string &name, F &&value_text) {
+    vector<long> parents = random_parents(nodes, 3, 42);
+    string text;
+    for (size_t i = 0; i < nodes; ++i) {
+        text += (parents[i] < 0 ? string() : to_string(parents[i])) + ',' + to_string(i) + ',' + value_text(i) + '\n';
+    }
+
+    report_throughput(name + " CSV", time_ms([&] {
+        istringstream in(text);
+        Tree<T> tree(3);
+        load_tree_csv(tree, in);
+    }), text.size());
+}
+
+/**
+ * Measure the CSV loader for every supported value type
+ * 
+ * @param nodes The number of nodes
+ */
+void bench_csv(size_t nodes) {
+    bench_csv_type<int>(nodes, "int", [](size_t i) { return to_string(i * 7919 % 1000003); });
+    bench_csv_type<double>(nodes, "double", [](size_t i) { return to_string(i * 0.37 - 1000); });
+    bench_csv_type<string>(nodes, "string", [](size_t i) { return "node number " + to_string(i); });
+    bench_csv_type<Complex>(nodes, "Complex", [](size_t i) { return to_string(i * 0.5) + ',' + to_string(-1.25 * i); });
+}
+
+/**
+ * Compare printing a pre-order traversal value by value with a flush after each one (like print_traversals did)
+ * with the traversal writer in each of its formats, all to /dev/null
+ *
+ * @param nodes The number of nodes
+ */
+void bench_traversal_writer(size_t nodes) {
+    Tree<double> doubles(3);
+    Tree<Complex> complexes(3);
+    vector<long> parents = random_parents(nodes, 3, 42);
+    vector<double> doubleValues(nodes);
+    vector<Complex> complexValues(nodes, Complex(0, 0));
+    for (size_t i = 0; i < nodes; ++i) {
+        doubleValues[i] = i * 0.37 - 1000;
+        complexValues[i] = Complex(i * 0.5, -1.25 * i);
+    }
+    doubles.build_from_parents(doubleValues, parents);
+    complexes.build_from_parents(complexValues, parents);
+
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd < 0) {
+        cout << "(no /dev/null, skipped)" << endl;
+        return;
+    }
+
+    report("double, ostream << value << flush", time_ms([&] {
+        ofstream out("/dev/null");
+        bool first = true;
+        for (auto node = doubles.begin_pre_order(); node != doubles.end_pre_order(); ++node) {
+            if (!first) {
+                out << ", " << flush;
+            }
+            out << node->get_value() << flush;
+            first = false;
+        }
+    }, 1));
+
+    auto bench_format = [&](const string &name, TraversalFormat format, auto &tree) {
+        size_t bytes = 0;
+        double ms = time_ms([&] {
+            TraversalWriter writer(fd, format);
+            writer.write_traversal("Pre-order traversal:", tree.begin_pre_order(), tree.end_pre_order());
+            writer.flush();
+            bytes = writer.bytes_written();
+        });
+        report_throughput(name, ms, bytes);
+    };
+
+    bench_format("double, writer text", TraversalFormat::text, doubles);
+    bench_format("double, writer JSON lines", TraversalFormat::json_lines, doubles);
+    bench_format("double, writer binary", TraversalFormat::binary, doubles);
+    bench_format("Complex, writer text", TraversalFormat::text, complexes);
+    bench_format("Complex, writer JSON lines", TraversalFormat::json_lines, complexes);
+    bench_format("Complex, writer binary", TraversalFormat::binary, complexes);
+
+    close(fd);
+}
+
+/**
+ * Compare laying out a whole tree with adding one node to a layout
+ *
+ * @param nodes The number of nodes
+ */
+void bench_layout(size_t nodes) {
+    Tree<int> tree(3);
+    build_random_tree(tree, nodes, 3);
+
+    TreeLayout<Node<int>> layout;
+    report("layout compute", time_ms([&] { layout.compute(tree.get_root()); }));
+
+    // Leaves get the new nodes, so the tree keeps its arity
+    vector<Node<int> *> leaves;
+    tree.for_each_pre_order([&](Node<int> &node) {
+        if (node.get_children().empty()) leaves.push_back(&node);
+    });
+
+    Node<int> *first = &tree.create_node(-1);
+    tree.add_sub_node(*leaves[0], *first);
+    report("layout add_node (first, numbers the nodes)", time_ms([&] { layout.add_node(leaves[0], first); }, 1));
+
+    size_t next = 1;
+    report("layout add_node", time_ms([&] {
+        Node<int> *added = &tree.create_node(-1);
+        tree.add_sub_node(*leaves[next], *added);
+        layout.add_node(leaves[next], added);
+        ++next;
+    }, 5));
+}
+
+/**
+ * Measure the layout index: building it, adding nodes to it, and the queries of a window sized view close up and from far away
+ *
+ * @param nodes The number of nodes
+ */
+void bench_layout_index(size_t nodes) {
+    Tree<int> tree(3);
+    build_random_tree(tree, nodes, 3);
+
+    TreeLayout<Node<int>> layout;
+    layout.compute(tree.get_root());
+
+    LayoutIndex<Node<int>> index;
+    report("layout index build", time_ms([&] { index.build(layout); }));
+
+    // Leaves get the new nodes, and the numbers of the nodes are made before the timing, like after a first add_node
+    vector<Node<int> *> leaves;
+    tree.for_each_pre_order([&](Node<int> &node) {
+        if (node.get_children().empty()) leaves.push_back(&node);
+    });
+    layout.number_of(leaves[0]);
+
+    size_t next = 0;
+    report("layout add_node + index add_nodes", time_ms([&] {
+        Node<int> *parent = leaves[next++];
+        Node<int> *added = &tree.create_node(-1);
+        tree.add_sub_node_direct(*parent, *added);
+        index.add_nodes(layout.add_node(parent, added));
+    }, 5));
+
+    // A 900x800 window around the root at zoom 1, then zoomed out 100 times and to the whole tree width
+    size_t found = 0;
+    report("nodes in a window", time_ms([&] {
+        found = 0;
+        index.for_each_in({-450.f, -100.f, 450.f, 700.f}, [&](uint32_t) { ++found; });
+    }));
+    cout << "(" << found << " nodes)" << endl;
+
+    LayoutBounds bounds = layout.bounds();
+    for (float scale : {100.f, (bounds.right - bounds.left) / 900.f}) {
+        LayoutBounds area{-450.f * scale, -100.f * scale, 450.f * scale, 700.f * scale};
+        size_t opened = 0, summaries = 0;
+        report("level of detail zoomed out " + to_string(lround(scale)) + " times", time_ms([&] {
+            opened = summaries = 0;
+            index.for_each_level_of_detail(area, 8.f * scale, 100.f, [&](uint32_t) { ++opened; }, [&](uint32_t) { ++summaries; });
+        }));
+        cout << "(" << opened << " nodes and " << summaries << " summaries)" << endl;
+    }
+}
+
+/**
+ * Measure headless snapshots: a batch of small trees, and one snapshot of the whole tree
+ *
+ * @param nodes The number of nodes of the big tree
+ */
+void bench_snapshots(size_t nodes) {
+    Tree<int> small(3), big(3);
+    build_random_tree(small, 1000, 3);
+    build_random_tree(big, nodes, 3);
+
+    TreeSnapshotWriter batch;
+    report("1000 snapshots of 1000 nodes", time_ms([&] {
+        for (int i = 0; i < 1000; ++i) batch.render(small);
+    }, 1));
+    cout << "(per snapshot " << batch.total_ms() / batch.frame_count() << " ms, slowest " << batch.slowest_ms() << " ms)" << endl;
+
+    TreeSnapshotWriter single;
+    single.render(big);
+    const SnapshotTiming &timing = single.last_timing();
+    report("snapshot layout", timing.layoutMs);
+    report_throughput("snapshot render", timing.renderMs, timing.bytes);
+}
+
+/**
+ * One result of the benchmark suite
+ */
+struct BenchResult {
+    string operation;
+    string type;
+    size_t arity;
+    size_t nodes;
+    int repeats;
+    double ms; // The best time of the repeats
+};
+
+// Keeps the values read by the suite, so the traversals are not optimized away
+long long suiteChecksum = 0;
+
+template <typename T>
+string type_name() {
+    if constexpr (is_same<T, int>::value) {
+        return "int";
+    } else if constexpr (is_same<T, double>::value) {
+        return "double";
+    } else if constexpr (is_same<T, string>::value) {
+        return "string";
+    } else {
+        return "Complex";
+    }
+}
+
+template <typename T>
+T random_value(mt19937_64 &random) {
+    if constexpr (is_same<T, int>::value) {
+        return static_cast<int>(random());
+    } else if constexpr (is_same<T, double>::value) {
+        return uniform_real_distribution<double>(-1e6, 1e6)(random);
+    } else if constexpr (is_same<T, string>::value) {
+        return "node-" + to_string(random() % 1000000000);
+    } else {
+        uniform_real_distribution<double> part(-1e3, 1e3);
+        double real = part(random);
+        return Complex(real, part(random));
+    }
+}
+
+template <typename T>
+long long value_checksum(const T &value) {
+    if constexpr (is_arithmetic<T>::value) {
+        return static_cast<long long>(value);
+    } else if constexpr (is_same<T, string>::value) {
+        return static_cast<long long>(value.size());
+    } else {
+        return static_cast<long long>(value.get_real());
+    }
+}
+
+/**
+ * Measure how long a function takes on fresh state, the best time of a few runs (the setup is not timed)
+ * 
+ * @param setup The function that makes the state
+ * @param run The function to measure
+ * @param repeats The number of runs
+ * @return The best running time in milliseconds
+ */
+template <typename Setup, typename F>
+double time_ms(Setup &&setup, F &&run, int repeats) {
+    double best = 0;
+
+    for (int i = 0; i < repeats; ++i) {
+        setup();
+        double ms = time_ms(run, 1);
+        if (i == 0 || ms < best) {
+            best = ms;
+        }
+    }
+
+    return best;
+}
+
+// The biggest tree add_sub_node is timed on without the index, its build is O(N^2)
+constexpr size_t SUITE_PLAIN_ADD_MAX_NODES = 10000;
+
+/**
+ * A rough upper bound of the memory the suite needs for a tree: the nodes, their child vectors, the index
+ * of add_sub_node, the values and the parents
+ * 
+ * @param nodes The number of nodes
+ * @return The number of bytes
+ */
+template <typename T>
+size_t suite_bytes(size_t nodes) {
+    return nodes * (sizeof(Node<T>) + 2 * sizeof(T) + sizeof(long) + 128);
+}
+
+/**
+ * Time building, traversing and heap-ordering a random k-ary tree of one value type
+ * 
+ * @param nodes The number of nodes
+ * @param k The maximum number of children
+ * @param repeats The number of runs of each operation
+ * @param results The results to add to
+ */
+template <typename T>
+void bench_suite_type(size_t nodes, size_t k, int repeats, vector<BenchResult> &results) {
+    using TreeType = Tree<T>;
+    using NodeType = typename TreeType::NodeType;
+
+    mt19937_64 random(nodes * 31 + k);
+    vector<T> values(nodes);
+    for (auto &value : values) {
+        value = random_value<T>(random);
+    }
+    vector<long> parents = random_parents(nodes, k, 42);
+
+    string name = type_name<T>() + " " + to_string(k) + "-ary";
+    auto add = [&](const string &operation, double ms) {
+        results.push_back({operation, type_name<T>(), k, nodes, repeats, ms});
+        report(name + " " + operation, ms);
+    };
+
+    // Building node by node, with and without the index that makes the parent search of add_sub_node constant time
+    unique_ptr<TreeType> tree;
+    vector<NodeType *> added(nodes);
+    auto fresh = [&] {
+        tree.reset();
+        tree = make_unique<TreeType>(k);
+    };
+    auto build_nodes = [&](bool direct) {
+        added[0] = &tree->create_node(values[0]);
+        tree->add_root(*added[0]);
+        for (size_t i = 1; i < nodes; ++i) {
+            added[i] = &tree->create_node(values[i]);
+            if (direct) {
+                tree->add_sub_node_direct(*added[parents[i]], *added[i]);
+            } else {
+                tree->add_sub_node(*added[parents[i]], *added[i]);
+            }
+        }
+    };
+
+    // Without the index every insert searches the tree for the parent, so the build is quadratic and only timed on small trees.
+    // A repeated value can lead the search to another, full node - then there is no result for it.
+    if (nodes <= SUITE_PLAIN_ADD_MAX_NODES) {
+        try {
+            add("add_sub_node", time_ms(fresh, [&] { build_nodes(false); }, repeats));
+        } catch (const runtime_error &) {
+            cout << "(" << name << " add_sub_node skipped, a repeated value made the parent search find a full node)" << endl;
+        }
+    } else {
+        cout << "(" << name << " add_sub_node skipped, its parent search is O(N) above " << SUITE_PLAIN_ADD_MAX_NODES << " nodes)" << endl;
+    }
+    add("add_sub_node (indexed)", time_ms([&] { fresh(); tree->enable_index(); }, [&] { build_nodes(false); }, repeats));
+    add("add_sub_node_direct", time_ms(fresh, [&] { build_nodes(true); }, repeats));
+    add("build_from_parents", time_ms(fresh, [&] { tree->build_from_parents(values, parents); }, repeats));
+
+    long long sum = 0;
+    add("pre-order iterator", time_ms([&] {
+        for (auto it = tree->begin_pre_order(); it != tree->end_pre_order(); ++it) sum += value_checksum(it->get_value());
+    }, repeats));
+    add("post-order iterator", time_ms([&] {
+        for (auto it = tree->begin_post_order(); it != tree->end_post_order(); ++it) sum += value_checksum(it->get_value());
+    }, repeats));
+    add("in-order iterator", time_ms([&] {
+        for (auto it = tree->begin_in_order(); it != tree->end_in_order(); ++it) sum += value_checksum(it->get_value());
+    }, repeats));
+    add("BFS iterator", time_ms([&] {
+        for (auto it = tree->begin_bfs_scan(); it != tree->end_bfs_scan(); ++it) sum += value_checksum(it->get_value());
+    }, repeats));
+    add("default iterator", time_ms([&] {
+        for (auto &node : *tree) sum += value_checksum(node.get_value());
+    }, repeats));
+    add("heap iterator", time_ms([&] {
+        for (auto it = tree->begin_heap(); it != tree->end_heap(); ++it) sum += value_checksum(it->get_value());
+    }, repeats));
+
+    add("myHeap", time_ms([&] { fresh(); tree->build_from_parents(values, parents); }, [&] { tree->myHeap(); }, repeats));
+    add("heap iterator, heap-ordered", time_ms([&] {
+        for (auto it = tree->begin_heap(); it != tree->end_heap(); ++it) sum += value_checksum(it->get_value());
+    }, repeats));
+
+    suiteChecksum += sum;
+}
+
+/**
+ * Write the suite results as CSV, one line per result
+ * 
+ * @param results The results
+ * @param version The version of the code they are for
+ * @param path The file path
+ * 
+ * @throws runtime_error if the file can't be written
+ */
+void write_results_csv(const vector<BenchResult> &results, const string &version, const string &path) {
+    ofstream out(path);
+    out << "version,operation,type,arity,nodes,repeats,ms,ns_per_node\n" << setprecision(6);
+    for (const BenchResult &result : results) {
+        out << version << ',' << result.operation << ',' << result.type << ',' << result.arity << ',' << result.nodes << ','
+            << result.repeats << ',' << result.ms << ',' << result.ms * 1e6 / result.nodes << '\n';
+    }
+
+    out.close();
+    if (!out) {
+        throw runtime_error("############ Error: Can't write the benchmark results... ############");
+    }
+}
+
+/**
+ * Write the suite results as JSON: the version, the compiler and the list of results
+ * 
+ * @param results The results
+ * @param version The version of the code they are for
+ * @param path The file path
+ * 
+ * @throws runtime_error if the file can't be written
+ */
+void write_results_json(const vector<BenchResult> &results, const string &version, const string &path) {
+    ofstream out(path);
+    out << "{\n  \"version\": \"" << version << "\",\n  \"compiler\": \"" << __VERSION__ << "\",\n  \"results\": [" << setprecision(6);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult &result = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"operation\": \"" << result.operation << "\", \"type\": \"" << result.type
+            << "\", \"arity\": " << result.arity << ", \"nodes\": " << result.nodes << ", \"repeats\": " << result.repeats
+            << ", \"ms\": " << result.ms << ", \"ns_per_node\": " << result.ms * 1e6 / result.nodes << "}";
+    }
+    out << "\n  ]\n}\n";
+
+    out.close();
+    if (!out) {
+        throw runtime_error("############ Error: Can't write the benchmark results... ############");
+    }
+}
+
+/**
+ * Run the benchmark suite: every value type and arity, on trees of 10^3 nodes and up by powers of 10
+ * Trees that would not fit in the free memory are skipped
+ * 
+ * @param minNodes The smallest tree
+ * @param maxNodes The biggest tree
+ * @param arities The maximum numbers of children
+ * @return The results
+ */
+vector<BenchResult> bench_suite(size_t minNodes, size_t maxNodes, const vector<size_t> &arities) {
+    vector<BenchResult> results;
+    size_t freeBytes = static_cast<size_t>(sysconf(_SC_AVPHYS_PAGES)) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+    for (size_t nodes = minNodes; nodes <= maxNodes; nodes *= 10) {
+        // Big trees take long to build, one run is enough for them
+        int repeats = nodes >= 10000000 ? 1 : 3;
+        cout << "############ Suite on " << nodes << " nodes ############" << endl;
+
+        for (size_t k : arities) {
+            auto run = [&](auto type, size_t bytes) {
+                using T = decltype(type);
+                if (bytes > freeBytes) {
+                    cout << "(" << type_name<T>() << " " << k << "-ary skipped, it needs about " << bytes / 1000000 << " MB)" << endl;
+                    return;
+                }
+                bench_suite_type<T>(nodes, k, repeats, results);
+            };
+
+            run(int(), suite_bytes<int>(nodes));
+            run(double(), suite_bytes<double>(nodes));
+            run(string(), suite_bytes<string>(nodes));
+            run(Complex(), suite_bytes<Complex>(nodes));
+        }
+    }
+
+    cout << "(checksum " << suiteChecksum << ")" << endl;
+    return results;
+}
+
+int main(int argc, char *argv[]) {
+    // The suite: ./bench --suite [--min nodes] [--max nodes] [--arity k,k,...] [--json file] [--csv file] [--version name]
+    if (argc > 1 && string(argv[1]) == "--suite") {
+        size_t minNodes = 1000, maxNodes = 100000000;
+        vector<size_t> arities{2, 8};
+        string jsonPath, csvPath, version = "unknown";
+
+        for (int i = 2; i + 1 < argc; i += 2) {
+            string option = argv[i], value = argv[i + 1];
+            if (option == "--min") {
+                minNodes = max<size_t>(strtoull(value.c_str(), nullptr, 10), 1);
+            } else if (option == "--max") {
+                maxNodes = strtoull(value.c_str(), nullptr, 10);
+            } else if (option == "--arity") {
+                arities.clear();
+                stringstream list(value);
+                for (string k; getline(list, k, ',');) arities.push_back(max<size_t>(strtoull(k.c_str(), nullptr, 10), 2));
+            } else if (option == "--json") {
+                jsonPath = value;
+            } else if (option == "--csv") {
+                csvPath = value;
+            } else if (option == "--version") {
+                version = value;
+            } else {
+                cerr << "############ Error: Unknown option " << option << " ############" << endl;
+                return 1;
+            }
+        }
+
+        try {
+            vector<BenchResult> results = bench_suite(minNodes, maxNodes, arities);
+            if (!jsonPath.empty()) write_results_json(results, version, jsonPath);
+            if (!csvPath.empty()) write_results_csv(results, version, csvPath);
+        } catch (const runtime_error &error) {
+            cerr << error.what() << endl;
+            return 1;
+        }
+
+        return 0;
+    }
+
+    // The number of nodes can be given as the first argument, like ./bench 10000000
+    size_t nodes = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+
+    cout << "############ Traversals of " << nodes << " nodes ############" << endl;
+
+    {
+        Tree<int, 2> binaryTree;
+        build_random_tree(binaryTree, nodes, 2);
+        bench_traversals(binaryTree, "binary");
+    }
+
+    {
+        Tree<int> threeAryTree(3);
+        build_random_tree(threeAryTree, nodes, 3);
+        bench_traversals(threeAryTree, "3-ary");
+        bench_parallel(threeAryTree, nodes, "3-ary");
+    }
+
+    {
+        // High fan-out, where finding the next child of a node used to scan all its children
+        Tree<int> wideTree(64);
+        build_random_tree(wideTree, nodes, 64);
+
+        long long sum = 0;
+        vector<Tree<int>::PostOrderFrame> scratch;
+
+        report("64-ary post-order iterator", time_ms([&] {
+            for (auto it = wideTree.begin_post_order(scratch); it != wideTree.end_post_order(); ++it) sum += it->get_value();
+        }));
+        report("64-ary for_each_post_order", time_ms([&] {
+            wideTree.for_each_post_order([&](Node<int> &node) { sum += node.get_value(); });
+        }));
+
+        cout << "(checksum " << sum << ")" << endl;
+    }
+
+    cout << "############ Heaps of " << nodes << " nodes ############" << endl;
+    bench_heap(nodes, 2);
+    bench_heap(nodes, 8);
+
+    cout << "############ Top-k of " << nodes << " nodes ############" << endl;
+    bench_top_k(nodes);
+
+    cout << "############ Tree files of " << nodes << " nodes ############" << endl;
+    bench_tree_file(nodes);
+
+    cout << "############ CSV loading of " << nodes << " nodes ############" << endl;
+    bench_csv(nodes);
+
+    cout << "############ Traversal output of " << nodes << " nodes ############" << endl;
+    bench_traversal_writer(nodes);
+
+    cout << "############ Layout of " << nodes << " nodes ############" << endl;
+    bench_layout(nodes);
+
+    cout << "############ Layout index of " << nodes << " nodes ############" << endl;
+    bench_layout_index(nodes);
+
+    cout << "############ Snapshots of " << nodes << " nodes ############" << endl;
+    bench_snapshots(nodes);
+
+    cout << "############ Complex kernels on " << nodes << " numbers ############" << endl;
+    bench_complex_kernels(nodes);
+
+    return 0;
+}
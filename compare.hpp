@@ -0,0 +1,81 @@
+// noavrd@gmail.com
+
+#ifndef COMPARE_HPP
+#define COMPARE_HPP
+
+#include <utility>
+#include <type_traits>
+
+using namespace std;
+
+/**
+ * The default order of the tree values, smallest first
+ *
+ * Only uses operator>, so it works for every value type the tree supports (like Complex)
+ */
+struct SmallerFirst {
+    template <typename T>
+    bool operator()(const T &a, const T &b) const {
+        return b > a;
+    }
+};
+
+/**
+ * The opposite order, biggest first (for max-heaps and the k largest values)
+ */
+struct BiggerFirst {
+    template <typename T>
+    bool operator()(const T &a, const T &b) const {
+        return a > b;
+    }
+};
+
+/**
+ * Order values by a key computed from each of them, like the magnitude of a complex number
+ *
+ * @tparam Projection The function that computes the key of a value
+ * @tparam Order The order of the keys
+ */
+template <typename Projection, typename Order = SmallerFirst>
+class ByKey {
+private:
+    Projection key; // Computes the key of a value
+    Order order;    // Compares two keys
+
+public:
+    explicit ByKey(Projection key, Order order = Order()) : key(move(key)), order(move(order)) {}
+
+    template <typename T>
+    bool operator()(const T &a, const T &b) const {
+        return order(key(a), key(b));
+    }
+};
+
+/**
+ * Make a ByKey order without writing its types
+ *
+ * @param key The function that computes the key of a value, like [](const Complex &z) { return z.norm(); }
+ * @param order The order of the keys, SmallerFirst by default
+ * @return The order of the values by their keys
+ */
+template <typename Order = SmallerFirst, typename Projection>
+ByKey<Projection, Order> by_key(Projection key, Order order = Order()) {
+    return ByKey<Projection, Order>(move(key), move(order));
+}
+
+/**
+ * Whether all the orders of a type are the same order, so the type alone tells which order a tree is heap-ordered by
+ *
+ * True for orders with no state (SmallerFirst, BiggerFirst, lambdas that capture nothing) and ByKey of those,
+ * false for function pointers, std::function and objects with members, which can hold different orders.
+ *
+ * @tparam Compare The order type
+ */
+template <typename Compare>
+struct is_stateless_order : is_empty<Compare> {};
+
+template <typename Projection, typename Order>
+struct is_stateless_order<ByKey<Projection, Order>>
+    : integral_constant<bool, is_empty<Projection>::value && is_stateless_order<Order>::value> {};
+
+#endif // COMPARE_HPP
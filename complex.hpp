@@ -4,6 +4,13 @@
 #define COMPLEX_HPP
 
 #include <iostream>
+#include <functional>
+#include <cmath>
+#include <type_traits>
+
+#if defined(__cpp_impl_three_way_comparison) && __cpp_impl_three_way_comparison >= 201907L
+#include <compare>
+#endif
 
 using namespace std; 
 
@@ -13,23 +20,90 @@ private:
     double real; 
     double imag; 
 public:
+    /**
+     * Constructor for zero
+     */
+    constexpr Complex() noexcept : real(0), imag(0) {}
+
     /**
      * Constructor with the real and imagine parts
      * 
      * @param real The real part of the complex number
      * @param imag The imagine part of the complex number
      */
-    Complex(double real, double imag) : real(real), imag(imag) {}
+    constexpr Complex(double real, double imag) noexcept : real(real), imag(imag) {}
 
     /**     
      * @return The real part of the complex number
      */
-    double get_real() const { return real; }
+    constexpr double get_real() const noexcept { return real; }
 
     /**
      * @return The imagine part of the complex number
      */
-    double get_imag() const { return imag; }
+    constexpr double get_imag() const noexcept { return imag; }
+
+    /**
+     * @return The squared magnitude real^2 + imag^2
+     */
+    constexpr double norm() const noexcept {
+        return real * real + imag * imag;
+    }
+
+    /**
+     * Not constexpr, since sqrt is not before C++26
+     * 
+     * @return The magnitude sqrt(real^2 + imag^2), the same as complex_magnitude of ComplexArray
+     */
+    double abs() const noexcept {
+        return sqrt(norm());
+    }
+
+    /**
+     * @return The conjugate, with the imagine part negated
+     */
+    constexpr Complex conj() const noexcept {
+        return Complex(real, -imag);
+    }
+
+    constexpr Complex operator-() const noexcept {
+        return Complex(-real, -imag);
+    }
+
+    constexpr Complex operator+(const Complex& other) const noexcept {
+        return Complex(real + other.real, imag + other.imag);
+    }
+
+    constexpr Complex operator-(const Complex& other) const noexcept {
+        return Complex(real - other.real, imag - other.imag);
+    }
+
+    /**
+     * Multiplies with the same formula as complex_multiply of ComplexArray, so the results are the same bits
+     * 
+     * @param other The complex number to multiply by
+     * @return The product
+     */
+    constexpr Complex operator*(const Complex& other) const noexcept {
+        return Complex(real * other.real - imag * other.imag, real * other.imag + imag * other.real);
+    }
+
+    /**
+     * Divides by multiplying with the conjugate, a division by zero gives inf or nan parts
+     * 
+     * @param other The complex number to divide by
+     * @return The quotient
+     */
+    constexpr Complex operator/(const Complex& other) const noexcept {
+        double denominator = other.norm();
+        return Complex((real * other.real + imag * other.imag) / denominator,
+                       (imag * other.real - real * other.imag) / denominator);
+    }
+
+    constexpr Complex& operator+=(const Complex& other) noexcept { return *this = *this + other; }
+    constexpr Complex& operator-=(const Complex& other) noexcept { return *this = *this - other; }
+    constexpr Complex& operator*=(const Complex& other) noexcept { return *this = *this * other; }
+    constexpr Complex& operator/=(const Complex& other) noexcept { return *this = *this / other; }
 
     /**
      * Compares this complex number with another with bigger-than
@@ -39,10 +113,23 @@ public:
      * @param other The complex number to compare
      * @return true if this complex number is bigger, false if not
      */
-    bool operator>(const Complex& other) const {
+    constexpr bool operator>(const Complex& other) const noexcept {
         return (real > other.real) || (real == other.real && imag > other.imag);
     }
 
+    /**
+     * Compares this complex number with another with smaller-than, in the same order as operator>
+     * 
+     * @param other The complex number to compare
+     * @return true if this complex number is smaller, false if not
+     */
+    constexpr bool operator<(const Complex& other) const noexcept {
+        return other > *this;
+    }
+
+    constexpr bool operator>=(const Complex& other) const noexcept { return *this > other || *this == other; }
+    constexpr bool operator<=(const Complex& other) const noexcept { return *this < other || *this == other; }
+
     /**
      * Compares this complex number with another for equality
      * 
@@ -51,10 +138,27 @@ public:
      * @param other The complex number to compare
      * @return true if both complex numbers are equal, false if not
      */
-    bool operator==(const Complex& other) const {
+    constexpr bool operator==(const Complex& other) const noexcept {
         return real == other.real && imag == other.imag;
     }
 
+    constexpr bool operator!=(const Complex& other) const noexcept {
+        return !(*this == other);
+    }
+
+#if defined(__cpp_impl_three_way_comparison) && __cpp_impl_three_way_comparison >= 201907L
+    /**
+     * Three-way comparison in the same order as operator> (unordered when a part is nan)
+     * 
+     * @param other The complex number to compare
+     * @return The ordering of this complex number compared to the other
+     */
+    constexpr partial_ordering operator<=>(const Complex& other) const noexcept {
+        partial_ordering byReal = real <=> other.real;
+        return byReal != 0 ? byReal : imag <=> other.imag;
+    }
+#endif
+
     /**
      * Print the complex number to an output stream in the format "real + imag + i"
      * 
@@ -69,4 +173,22 @@ public:
 
 };
 
+// Complex numbers are copied around by value (in nodes, arrays and heaps), so copying must stay a plain memcpy
+static_assert(is_trivially_copyable<Complex>::value, "Complex must be trivially copyable");
+
+/**
+ * Hash for complex numbers, so they can be used in hash containers (like the tree index)
+ * 
+ * Combines the hashes of the real and imagine parts
+ */
+namespace std {
+    template <>
+    struct hash<Complex> {
+        size_t operator()(const Complex& c) const noexcept {
+            size_t h = hash<double>()(c.get_real());
+            return h ^ (hash<double>()(c.get_imag()) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2));
+        }
+    };
+}
+
 #endif // COMPLEX_HPP
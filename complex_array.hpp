@@ -0,0 +1,477 @@
+// noavrd@gmail.com
+
+#ifndef COMPLEX_ARRAY_HPP
+#define COMPLEX_ARRAY_HPP
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+#include "complex.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define COMPLEX_ARRAY_X86 1
+#endif
+
+using namespace std;
+
+/**
+ * The kernels that work on complex arrays
+ *
+ * best picks the fastest one the CPU supports (checked once at runtime), the others force one,
+ * which is mostly for tests and benchmarks. All of them give exactly the same results.
+ */
+enum class ComplexKernel {
+    best,
+    scalar,
+    sse2,
+    avx2
+};
+
+/**
+ * A read-only view over complex numbers kept in two arrays, one for the real parts and one for the imagine parts
+ */
+class ComplexSpan {
+private:
+    const double *reals; // The real parts
+    const double *imags; // The imagine parts
+    size_t count;        // Number of complex numbers
+
+public:
+    ComplexSpan(const double *reals, const double *imags, size_t count) : reals(reals), imags(imags), count(count) {}
+
+    const double *real_data() const { return reals; }
+    const double *imag_data() const { return imags; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    Complex operator[](size_t i) const {
+        return Complex(reals[i], imags[i]);
+    }
+};
+
+/**
+ * ComplexArray class
+ *
+ * Complex numbers in structure-of-arrays layout (all the real parts, then all the imagine parts),
+ * so the kernels below can load a few of them into one SIMD register.
+ */
+class ComplexArray {
+private:
+    vector<double> reals; // The real parts
+    vector<double> imags; // The imagine parts
+
+public:
+    ComplexArray() = default;
+
+    /**
+     * Constructor for an array of zeros
+     *
+     * @param count The number of complex numbers
+     */
+    explicit ComplexArray(size_t count) : reals(count, 0.0), imags(count, 0.0) {}
+
+    /**
+     * Constructor from a range of complex numbers, like a vector or the values of a FrozenTree
+     *
+     * @param first The first complex number
+     * @param last The end of the range
+     */
+    template <typename It>
+    ComplexArray(It first, It last) {
+        for (; first != last; ++first) {
+            push_back(*first);
+        }
+    }
+
+    explicit ComplexArray(const vector<Complex> &values) : ComplexArray(values.begin(), values.end()) {}
+
+    size_t size() const { return reals.size(); }
+    bool empty() const { return reals.empty(); }
+
+    void resize(size_t count) {
+        reals.resize(count, 0.0);
+        imags.resize(count, 0.0);
+    }
+
+    void reserve(size_t count) {
+        reals.reserve(count);
+        imags.reserve(count);
+    }
+
+    void push_back(const Complex &value) {
+        reals.push_back(value.get_real());
+        imags.push_back(value.get_imag());
+    }
+
+    Complex operator[](size_t i) const {
+        return Complex(reals[i], imags[i]);
+    }
+
+    void set(size_t i, const Complex &value) {
+        reals[i] = value.get_real();
+        imags[i] = value.get_imag();
+    }
+
+    double *real_data() { return reals.data(); }
+    double *imag_data() { return imags.data(); }
+    const double *real_data() const { return reals.data(); }
+    const double *imag_data() const { return imags.data(); }
+
+    ComplexSpan span() const {
+        return ComplexSpan(reals.data(), imags.data(), reals.size());
+    }
+
+    operator ComplexSpan() const {
+        return span();
+    }
+};
+
+/**
+ * The scalar kernels, the reference for the SIMD ones, with the same formulas as the Complex operators
+ *
+ * The formulas are written out with no fused multiply-add, so every kernel rounds the same way
+ * (the compiler does not fuse them either in a -std=c++17 build, without GNU extensions).
+ */
+struct ScalarComplexKernels {
+    static void add(const double *ar, const double *ai, const double *br, const double *bi,
+                    double *outReal, double *outImag, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            outReal[i] = ar[i] + br[i];
+            outImag[i] = ai[i] + bi[i];
+        }
+    }
+
+    static void multiply(const double *ar, const double *ai, const double *br, const double *bi,
+                         double *outReal, double *outImag, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            double real = ar[i] * br[i] - ai[i] * bi[i];
+            double imag = ar[i] * bi[i] + ai[i] * br[i];
+            outReal[i] = real;
+            outImag[i] = imag;
+        }
+    }
+
+    static void scale(const double *ar, const double *ai, double fr, double fi,
+                      double *outReal, double *outImag, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            double real = ar[i] * fr - ai[i] * fi;
+            double imag = ar[i] * fi + ai[i] * fr;
+            outReal[i] = real;
+            outImag[i] = imag;
+        }
+    }
+
+    static void magnitude(const double *ar, const double *ai, double *out, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = sqrt(ar[i] * ar[i] + ai[i] * ai[i]);
+        }
+    }
+
+    static void greater(const double *ar, const double *ai, const double *br, const double *bi,
+                        uint8_t *out, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = (ar[i] > br[i]) || (ar[i] == br[i] && ai[i] > bi[i]);
+        }
+    }
+};
+
+#if defined(COMPLEX_ARRAY_X86) && defined(__SSE2__)
+/**
+ * The SSE2 kernels, 2 complex numbers at a time (SSE2 is always there on x86-64)
+ */
+struct Sse2ComplexKernels {
+    static void add(const double *ar, const double *ai, const double *br, const double *bi,
+                    double *outReal, double *outImag, size_t count) {
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2) {
+            _mm_storeu_pd(outReal + i, _mm_add_pd(_mm_loadu_pd(ar + i), _mm_loadu_pd(br + i)));
+            _mm_storeu_pd(outImag + i, _mm_add_pd(_mm_loadu_pd(ai + i), _mm_loadu_pd(bi + i)));
+        }
+        ScalarComplexKernels::add(ar + i, ai + i, br + i, bi + i, outReal + i, outImag + i, count - i);
+    }
+
+    static void multiply(const double *ar, const double *ai, const double *br, const double *bi,
+                         double *outReal, double *outImag, size_t count) {
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2) {
+            __m128d xr = _mm_loadu_pd(ar + i), xi = _mm_loadu_pd(ai + i);
+            __m128d yr = _mm_loadu_pd(br + i), yi = _mm_loadu_pd(bi + i);
+            _mm_storeu_pd(outReal + i, _mm_sub_pd(_mm_mul_pd(xr, yr), _mm_mul_pd(xi, yi)));
+            _mm_storeu_pd(outImag + i, _mm_add_pd(_mm_mul_pd(xr, yi), _mm_mul_pd(xi, yr)));
+        }
+        ScalarComplexKernels::multiply(ar + i, ai + i, br + i, bi + i, outReal + i, outImag + i, count - i);
+    }
+
+    static void scale(const double *ar, const double *ai, double fr, double fi,
+                      double *outReal, double *outImag, size_t count) {
+        __m128d yr = _mm_set1_pd(fr), yi = _mm_set1_pd(fi);
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2) {
+            __m128d xr = _mm_loadu_pd(ar + i), xi = _mm_loadu_pd(ai + i);
+            _mm_storeu_pd(outReal + i, _mm_sub_pd(_mm_mul_pd(xr, yr), _mm_mul_pd(xi, yi)));
+            _mm_storeu_pd(outImag + i, _mm_add_pd(_mm_mul_pd(xr, yi), _mm_mul_pd(xi, yr)));
+        }
+        ScalarComplexKernels::scale(ar + i, ai + i, fr, fi, outReal + i, outImag + i, count - i);
+    }
+
+    static void magnitude(const double *ar, const double *ai, double *out, size_t count) {
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2) {
+            __m128d xr = _mm_loadu_pd(ar + i), xi = _mm_loadu_pd(ai + i);
+            _mm_storeu_pd(out + i, _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(xr, xr), _mm_mul_pd(xi, xi))));
+        }
+        ScalarComplexKernels::magnitude(ar + i, ai + i, out + i, count - i);
+    }
+
+    static void greater(const double *ar, const double *ai, const double *br, const double *bi,
+                        uint8_t *out, size_t count) {
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2) {
+            __m128d xr = _mm_loadu_pd(ar + i), xi = _mm_loadu_pd(ai + i);
+            __m128d yr = _mm_loadu_pd(br + i), yi = _mm_loadu_pd(bi + i);
+            __m128d bigger = _mm_or_pd(_mm_cmpgt_pd(xr, yr), _mm_and_pd(_mm_cmpeq_pd(xr, yr), _mm_cmpgt_pd(xi, yi)));
+            int mask = _mm_movemask_pd(bigger);
+            out[i] = mask & 1;
+            out[i + 1] = (mask >> 1) & 1;
+        }
+        ScalarComplexKernels::greater(ar + i, ai + i, br + i, bi + i, out + i, count - i);
+    }
+};
+#endif
+
+#if defined(COMPLEX_ARRAY_X86)
+/**
+ * The AVX2 kernels, 4 complex numbers at a time
+ *
+ * They are compiled for AVX2 even when the rest of the program is not, and only used when the CPU has it.
+ */
+struct Avx2ComplexKernels {
+    __attribute__((target("avx2")))
+    static void add(const double *ar, const double *ai, const double *br, const double *bi,
+                    double *outReal, double *outImag, size_t count) {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            _mm256_storeu_pd(outReal + i, _mm256_add_pd(_mm256_loadu_pd(ar + i), _mm256_loadu_pd(br + i)));
+            _mm256_storeu_pd(outImag + i, _mm256_add_pd(_mm256_loadu_pd(ai + i), _mm256_loadu_pd(bi + i)));
+        }
+        ScalarComplexKernels::add(ar + i, ai + i, br + i, bi + i, outReal + i, outImag + i, count - i);
+    }
+
+    __attribute__((target("avx2")))
+    static void multiply(const double *ar, const double *ai, const double *br, const double *bi,
+                         double *outReal, double *outImag, size_t count) {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m256d xr = _mm256_loadu_pd(ar + i), xi = _mm256_loadu_pd(ai + i);
+            __m256d yr = _mm256_loadu_pd(br + i), yi = _mm256_loadu_pd(bi + i);
+            _mm256_storeu_pd(outReal + i, _mm256_sub_pd(_mm256_mul_pd(xr, yr), _mm256_mul_pd(xi, yi)));
+            _mm256_storeu_pd(outImag + i, _mm256_add_pd(_mm256_mul_pd(xr, yi), _mm256_mul_pd(xi, yr)));
+        }
+        ScalarComplexKernels::multiply(ar + i, ai + i, br + i, bi + i, outReal + i, outImag + i, count - i);
+    }
+
+    __attribute__((target("avx2")))
+    static void scale(const double *ar, const double *ai, double fr, double fi,
+                      double *outReal, double *outImag, size_t count) {
+        __m256d yr = _mm256_set1_pd(fr), yi = _mm256_set1_pd(fi);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m256d xr = _mm256_loadu_pd(ar + i), xi = _mm256_loadu_pd(ai + i);
+            _mm256_storeu_pd(outReal + i, _mm256_sub_pd(_mm256_mul_pd(xr, yr), _mm256_mul_pd(xi, yi)));
+            _mm256_storeu_pd(outImag + i, _mm256_add_pd(_mm256_mul_pd(xr, yi), _mm256_mul_pd(xi, yr)));
+        }
+        ScalarComplexKernels::scale(ar + i, ai + i, fr, fi, outReal + i, outImag + i, count - i);
+    }
+
+    __attribute__((target("avx2")))
+    static void magnitude(const double *ar, const double *ai, double *out, size_t count) {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m256d xr = _mm256_loadu_pd(ar + i), xi = _mm256_loadu_pd(ai + i);
+            _mm256_storeu_pd(out + i, _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(xr, xr), _mm256_mul_pd(xi, xi))));
+        }
+        ScalarComplexKernels::magnitude(ar + i, ai + i, out + i, count - i);
+    }
+
+    __attribute__((target("avx2")))
+    static void greater(const double *ar, const double *ai, const double *br, const double *bi,
+                        uint8_t *out, size_t count) {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m256d xr = _mm256_loadu_pd(ar + i), xi = _mm256_loadu_pd(ai + i);
+            __m256d yr = _mm256_loadu_pd(br + i), yi = _mm256_loadu_pd(bi + i);
+            __m256d bigger = _mm256_or_pd(_mm256_cmp_pd(xr, yr, _CMP_GT_OQ),
+                                          _mm256_and_pd(_mm256_cmp_pd(xr, yr, _CMP_EQ_OQ), _mm256_cmp_pd(xi, yi, _CMP_GT_OQ)));
+            int mask = _mm256_movemask_pd(bigger);
+            for (size_t j = 0; j < 4; ++j) {
+                out[i + j] = (mask >> j) & 1;
+            }
+        }
+        ScalarComplexKernels::greater(ar + i, ai + i, br + i, bi + i, out + i, count - i);
+    }
+};
+#endif
+
+/**
+ * Check if a kernel can run on this build and CPU
+ *
+ * @param kernel The kernel to check
+ * @return true if it can be used
+ */
+inline bool complex_kernel_supported(ComplexKernel kernel) {
+    switch (kernel) {
+    case ComplexKernel::best:
+    case ComplexKernel::scalar:
+        return true;
+    case ComplexKernel::sse2:
+#if defined(COMPLEX_ARRAY_X86) && defined(__SSE2__)
+        return true;
+#else
+        return false;
+#endif
+    case ComplexKernel::avx2:
+#if defined(COMPLEX_ARRAY_X86)
+        static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+        return hasAvx2;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+/**
+ * Run a function with the kernels of a given kind
+ *
+ * @param kernel The kernel kind, best for the fastest supported one
+ * @param run The function to call with the kernels struct
+ *
+ * @throws runtime_error if the kernel is not supported on this build or CPU
+ */
+template <typename F>
+void with_complex_kernels(ComplexKernel kernel, F &&run) {
+    if (!complex_kernel_supported(kernel)) {
+        throw runtime_error("############ Error: The complex kernel is not supported here... ############");
+    }
+
+    if (kernel == ComplexKernel::best) {
+        kernel = complex_kernel_supported(ComplexKernel::avx2) ? ComplexKernel::avx2
+               : complex_kernel_supported(ComplexKernel::sse2) ? ComplexKernel::sse2
+               : ComplexKernel::scalar;
+    }
+
+    switch (kernel) {
+#if defined(COMPLEX_ARRAY_X86)
+    case ComplexKernel::avx2:
+        run(Avx2ComplexKernels());
+        return;
+#endif
+#if defined(COMPLEX_ARRAY_X86) && defined(__SSE2__)
+    case ComplexKernel::sse2:
+        run(Sse2ComplexKernels());
+        return;
+#endif
+    default:
+        run(ScalarComplexKernels());
+        return;
+    }
+}
+
+// Check that two arrays have the same size for an element-wise kernel
+inline void check_same_size(const ComplexSpan &a, const ComplexSpan &b) {
+    if (a.size() != b.size()) {
+        throw runtime_error("############ Error: The complex arrays have different sizes... ############");
+    }
+}
+
+/**
+ * Add two complex arrays element by element
+ *
+ * @param a The first array
+ * @param b The second array
+ * @param out The result, resized to the size of the inputs (can be one of them)
+ * @param kernel The kernel to use
+ *
+ * @throws runtime_error if the sizes are different or the kernel is not supported
+ */
+inline void complex_add(ComplexSpan a, ComplexSpan b, ComplexArray &out, ComplexKernel kernel = ComplexKernel::best) {
+    check_same_size(a, b);
+    out.resize(a.size());
+    with_complex_kernels(kernel, [&](auto kernels) {
+        kernels.add(a.real_data(), a.imag_data(), b.real_data(), b.imag_data(), out.real_data(), out.imag_data(), a.size());
+    });
+}
+
+/**
+ * Multiply two complex arrays element by element
+ *
+ * @param a The first array
+ * @param b The second array
+ * @param out The result, resized to the size of the inputs (can be one of them)
+ * @param kernel The kernel to use
+ *
+ * @throws runtime_error if the sizes are different or the kernel is not supported
+ */
+inline void complex_multiply(ComplexSpan a, ComplexSpan b, ComplexArray &out, ComplexKernel kernel = ComplexKernel::best) {
+    check_same_size(a, b);
+    out.resize(a.size());
+    with_complex_kernels(kernel, [&](auto kernels) {
+        kernels.multiply(a.real_data(), a.imag_data(), b.real_data(), b.imag_data(), out.real_data(), out.imag_data(), a.size());
+    });
+}
+
+/**
+ * Multiply every complex number of an array by the same complex number
+ *
+ * @param a The array
+ * @param factor The number to multiply by
+ * @param out The result, resized to the size of the input (can be the input)
+ * @param kernel The kernel to use
+ *
+ * @throws runtime_error if the kernel is not supported
+ */
+inline void complex_scale(ComplexSpan a, const Complex &factor, ComplexArray &out, ComplexKernel kernel = ComplexKernel::best) {
+    out.resize(a.size());
+    with_complex_kernels(kernel, [&](auto kernels) {
+        kernels.scale(a.real_data(), a.imag_data(), factor.get_real(), factor.get_imag(), out.real_data(), out.imag_data(), a.size());
+    });
+}
+
+/**
+ * Get the magnitude sqrt(real^2 + imag^2) of every complex number of an array
+ *
+ * @param a The array
+ * @param out The magnitudes, resized to the size of the input
+ * @param kernel The kernel to use
+ *
+ * @throws runtime_error if the kernel is not supported
+ */
+inline void complex_magnitude(ComplexSpan a, vector<double> &out, ComplexKernel kernel = ComplexKernel::best) {
+    out.resize(a.size());
+    with_complex_kernels(kernel, [&](auto kernels) {
+        kernels.magnitude(a.real_data(), a.imag_data(), out.data(), a.size());
+    });
+}
+
+/**
+ * Compare two complex arrays element by element with the operator> of Complex (real part first, then imagine part)
+ *
+ * @param a The first array
+ * @param b The second array
+ * @param out 1 where a is bigger than b and 0 where not, resized to the size of the inputs
+ * @param kernel The kernel to use
+ *
+ * @throws runtime_error if the sizes are different or the kernel is not supported
+ */
+inline void complex_greater(ComplexSpan a, ComplexSpan b, vector<uint8_t> &out, ComplexKernel kernel = ComplexKernel::best) {
+    check_same_size(a, b);
+    out.resize(a.size());
+    with_complex_kernels(kernel, [&](auto kernels) {
+        kernels.greater(a.real_data(), a.imag_data(), b.real_data(), b.imag_data(), out.data(), a.size());
+    });
+}
+
+#endif // COMPLEX_ARRAY_HPP
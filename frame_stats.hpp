@@ -0,0 +1,83 @@
+// noavrd@gmail.com
+
+#ifndef FRAME_STATS_HPP
+#define FRAME_STATS_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <algorithm>
+
+using namespace std;
+
+/**
+ * FrameStats class
+ *
+ * Counts the frames of a window that only redraws when something changed: the times it woke up for events
+ * and the frames it drew for them, with the time of the last, the slowest and all the frames.
+ * A frame is timed from begin_frame() to end_frame().
+ */
+class FrameStats {
+private:
+    size_t wakeups;   // The number of times the window woke up for events
+    size_t frames;    // The number of frames drawn
+    double lastMs;    // The time of the last frame
+    double totalMs;   // The time of all the frames
+    double slowestMs; // The time of the slowest frame
+    chrono::steady_clock::time_point frameStart;
+
+public:
+    FrameStats() : wakeups(0), frames(0), lastMs(0.0), totalMs(0.0), slowestMs(0.0) {}
+
+    /**
+     * Counts a wake up for events, whether or not it draws a frame
+     */
+    void wake() {
+        ++wakeups;
+    }
+
+    void begin_frame() {
+        frameStart = chrono::steady_clock::now();
+    }
+
+    void end_frame() {
+        add_frame(chrono::duration<double, milli>(chrono::steady_clock::now() - frameStart).count());
+    }
+
+    /**
+     * Counts a frame that was timed elsewhere
+     *
+     * @param ms The time of the frame
+     */
+    void add_frame(double ms) {
+        ++frames;
+        lastMs = ms;
+        totalMs += ms;
+        slowestMs = max(slowestMs, ms);
+    }
+
+    size_t wakeup_count() const {
+        return wakeups;
+    }
+
+    size_t frame_count() const {
+        return frames;
+    }
+
+    double last_ms() const {
+        return lastMs;
+    }
+
+    double total_ms() const {
+        return totalMs;
+    }
+
+    double slowest_ms() const {
+        return slowestMs;
+    }
+
+    double average_ms() const {
+        return frames ? totalMs / frames : 0.0;
+    }
+};
+
+#endif // FRAME_STATS_HPP
@@ -0,0 +1,350 @@
+// noavrd@gmail.com
+
+#ifndef FROZEN_TREE_HPP
+#define FROZEN_TREE_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+
+using namespace std;
+
+/**
+ * FrozenTree class template
+ * 
+ * An immutable snapshot of a tree for read-heavy traversal, made by Tree::freeze().
+ * The values are kept in one array in pre-order (DFS) order, with the tree structure in parallel arrays,
+ * so every node is an index and every traversal is a scan over an array - no pointers and no stacks.
+ * 
+ * The nodes of the subtree of node i are i..i+subtree_size(i)-1, its first child is i+1,
+ * and the next sibling of a child j is j+subtree_size(j).
+ * 
+ * @tparam T The type of the values in the tree
+ */
+template <typename T>
+class FrozenTree {
+public:
+    // Marks a missing parent (for the root)
+    static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+    /**
+     * Iterator over the values of the tree in the order of an index array
+     */
+    class OrderIterator {
+    private:
+        const T *values;          // The values in pre-order
+        const uint32_t *position; // Current position in the index array
+
+    public:
+        using iterator_category = forward_iterator_tag;
+        using value_type = T;
+        using difference_type = ptrdiff_t;
+        using pointer = const T *;
+        using reference = const T &;
+
+        OrderIterator(const T *values, const uint32_t *position) : values(values), position(position) {}
+
+        bool operator!=(const OrderIterator &other) const {
+            return position != other.position;
+        }
+
+        bool operator==(const OrderIterator &other) const {
+            return position == other.position;
+        }
+
+        const T &operator*() const {
+            return values[*position];
+        }
+
+        const T *operator->() const {
+            return &values[*position];
+        }
+
+        // The index of the current node in the pre-order arrays
+        uint32_t index() const {
+            return *position;
+        }
+
+        OrderIterator &operator++() {
+            ++position;
+            return *this;
+        }
+    };
+
+    /**
+     * A range of values for range-based for loops
+     * 
+     * @tparam It The iterator type
+     */
+    template <typename It>
+    class Range {
+    private:
+        It first;
+        It last;
+        size_t count;
+
+    public:
+        Range(It first, It last, size_t count) : first(first), last(last), count(count) {}
+
+        It begin() const { return first; }
+        It end() const { return last; }
+        size_t size() const { return count; }
+    };
+
+private:
+    vector<T> values;               // The values in pre-order
+    vector<uint32_t> parents;       // The parent index of each node
+    vector<uint32_t> subtreeSizes;  // Number of nodes in the subtree of each node (including it)
+    vector<uint32_t> childCounts;   // Number of children of each node
+    vector<uint32_t> postOrder;     // Node indexes in post-order
+    vector<uint32_t> inOrder;       // Node indexes in in-order (pre-order for non binary trees)
+    vector<uint32_t> bfsOrder;      // Node indexes in BFS order
+
+    // Get the values range in the order of an index array
+    Range<OrderIterator> order_range(const vector<uint32_t> &order) const {
+        return Range<OrderIterator>(OrderIterator(values.data(), order.data()),
+                                    OrderIterator(values.data(), order.data() + order.size()), order.size());
+    }
+
+    // Build the post-order from the pre-order: the nodes before i in post-order are the nodes
+    // before it in pre-order except its ancestors, and the rest of its subtree
+    void build_post_order() {
+        vector<uint32_t> depths(values.size(), 0);
+        postOrder.assign(values.size(), 0);
+
+        for (uint32_t i = 0; i < values.size(); ++i) {
+            if (parents[i] != NO_NODE) {
+                depths[i] = depths[parents[i]] + 1;
+            }
+
+            postOrder[i - depths[i] + subtreeSizes[i] - 1] = i;
+        }
+    }
+
+    // Build the BFS order, using the result array itself as the queue
+    void build_bfs_order() {
+        bfsOrder.clear();
+        bfsOrder.reserve(values.size());
+
+        if (!values.empty()) {
+            bfsOrder.push_back(0);
+        }
+
+        for (size_t head = 0; head < bfsOrder.size(); ++head) {
+            uint32_t node = bfsOrder[head];
+            uint32_t child = node + 1;
+
+            for (uint32_t c = 0; c < childCounts[node]; ++c) {
+                bfsOrder.push_back(child);
+                child += subtreeSizes[child];
+            }
+        }
+    }
+
+    // Build the in-order of a binary tree, hasLeft tells if the first child of a node is its left child
+    void build_in_order(const vector<bool> &hasLeft) {
+        inOrder.clear();
+        inOrder.reserve(values.size());
+
+        vector<uint32_t> nodes;
+        uint32_t node = values.empty() ? NO_NODE : 0;
+
+        while (node != NO_NODE || !nodes.empty()) {
+            // Go down the left branch
+            while (node != NO_NODE) {
+                nodes.push_back(node);
+                node = hasLeft[node] ? node + 1 : NO_NODE;
+            }
+
+            node = nodes.back();
+            nodes.pop_back();
+            inOrder.push_back(node);
+
+            // Continue with the right child, which is the last child when there is one
+            uint32_t rightCount = childCounts[node] - (hasLeft[node] ? 1 : 0);
+            node = rightCount > 0 ? (hasLeft[node] ? node + 1 + subtreeSizes[node + 1] : node + 1) : NO_NODE;
+        }
+    }
+
+public:
+    /**
+     * Freeze the tree under a given root
+     * 
+     * Missing (null) children are skipped, like the iterators of Tree do.
+     * 
+     * @tparam N The node type
+     * @param root Pointer to the root node, or nullptr for an empty tree
+     * @param binary true if the in-order is the binary one (left, root, right), false for pre-order
+     * @param withOrders false to only keep the values and the structure (like for saving it to a file),
+     *                   then post_order, in_order and bfs_scan are empty
+     * 
+     * @throws runtime_error if the tree is too big for 32 bit indexes
+     */
+    template <typename N>
+    FrozenTree(const N *root, bool binary, bool withOrders = true) {
+        vector<bool> hasLeft;
+        vector<pair<const N *, uint32_t>> nodes; // Stack of nodes and their parent index
+
+        if (root) {
+            nodes.emplace_back(root, NO_NODE);
+        }
+
+        // Pre-order walk that copies the values and the parents
+        while (!nodes.empty()) {
+            auto [node, parent] = nodes.back();
+            nodes.pop_back();
+
+            if (values.size() >= NO_NODE) {
+                throw runtime_error("############ Error: The tree is too big to freeze... ############");
+            }
+
+            uint32_t index = static_cast<uint32_t>(values.size());
+            values.push_back(node->get_value());
+            parents.push_back(parent);
+            childCounts.push_back(0);
+
+            const auto &children = node->get_children();
+            hasLeft.push_back(!children.empty() && children[0] != nullptr);
+
+            for (auto child = children.rbegin(); child != children.rend(); ++child) {
+                if (*child != nullptr) {
+                    nodes.emplace_back(*child, index);
+                    ++childCounts[index];
+                }
+            }
+        }
+
+        // The children come after their parent, so going backwards gives the subtree sizes
+        subtreeSizes.assign(values.size(), 1);
+        for (size_t i = values.size(); i-- > 1;) {
+            subtreeSizes[parents[i]] += subtreeSizes[i];
+        }
+
+        if (!withOrders) {
+            return;
+        }
+
+        build_post_order();
+        build_bfs_order();
+
+        if (binary) {
+            build_in_order(hasLeft);
+        } else {
+            inOrder.resize(values.size());
+            for (uint32_t i = 0; i < values.size(); ++i) {
+                inOrder[i] = i;
+            }
+        }
+    }
+
+    /**
+     * @return The number of nodes
+     */
+    size_t size() const {
+        return values.size();
+    }
+
+    /**
+     * @return true if the tree has no nodes
+     */
+    bool empty() const {
+        return values.empty();
+    }
+
+    /**
+     * @param i The index of a node
+     * @return The value of the node
+     */
+    const T &value(uint32_t i) const {
+        return values[i];
+    }
+
+    /**
+     * @param i The index of a node
+     * @return The index of the parent of the node, or NO_NODE for the root
+     */
+    uint32_t parent(uint32_t i) const {
+        return parents[i];
+    }
+
+    /**
+     * @param i The index of a node
+     * @return The number of nodes in the subtree of the node, including it
+     */
+    uint32_t subtree_size(uint32_t i) const {
+        return subtreeSizes[i];
+    }
+
+    /**
+     * @param i The index of a node
+     * @return The number of children of the node
+     */
+    uint32_t child_count(uint32_t i) const {
+        return childCounts[i];
+    }
+
+    /**
+     * @param i The index of a node
+     * @return The index of the first child of the node, or NO_NODE if it has no children
+     */
+    uint32_t first_child(uint32_t i) const {
+        return childCounts[i] > 0 ? i + 1 : NO_NODE;
+    }
+
+    /**
+     * @param i The index of a node
+     * @return The index of the next sibling of the node, or NO_NODE if it is the last child
+     */
+    uint32_t next_sibling(uint32_t i) const {
+        uint32_t next = i + subtreeSizes[i];
+        uint32_t p = parents[i];
+        return (p != NO_NODE && next < p + subtreeSizes[p]) ? next : NO_NODE;
+    }
+
+    /**
+     * The arrays themselves, in pre-order, for code that writes or copies them in one go (like the tree file format)
+     */
+    const T *value_data() const { return values.data(); }
+    const uint32_t *parent_data() const { return parents.data(); }
+    const uint32_t *subtree_size_data() const { return subtreeSizes.data(); }
+    const uint32_t *child_count_data() const { return childCounts.data(); }
+
+    /**
+     * @return The values in pre-order
+     */
+    Range<const T *> pre_order() const {
+        return Range<const T *>(values.data(), values.data() + values.size(), values.size());
+    }
+
+    /**
+     * @return The values in DFS order (same as pre-order)
+     */
+    Range<const T *> dfs_scan() const {
+        return pre_order();
+    }
+
+    /**
+     * @return The values in post-order, empty if it was frozen without the orders
+     */
+    Range<OrderIterator> post_order() const {
+        return order_range(postOrder);
+    }
+
+    /**
+     * @return The values in in-order (pre-order for non binary trees), empty if it was frozen without the orders
+     */
+    Range<OrderIterator> in_order() const {
+        return order_range(inOrder);
+    }
+
+    /**
+     * @return The values in BFS order, empty if it was frozen without the orders
+     */
+    Range<OrderIterator> bfs_scan() const {
+        return order_range(bfsOrder);
+    }
+};
+
+#endif // FROZEN_TREE_HPP
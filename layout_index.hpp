@@ -0,0 +1,239 @@
+// noavrd@gmail.com
+
+#ifndef LAYOUT_INDEX_HPP
+#define LAYOUT_INDEX_HPP
+
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "tree_layout.hpp"
+
+using namespace std;
+
+/**
+ * LayoutIndex class template
+ *
+ * A spatial index over the node positions of a TreeLayout, so drawing a part of a big tree only touches the nodes
+ * that are there: the box of every subtree, to skip subtrees out of an area, to find the nodes in an area and to draw
+ * subtrees that are too small to see as one summary. The tree is the hierarchy of the boxes, like in a bounding
+ * volume hierarchy, so the index needs no structure of its own.
+ *
+ * The sides of a box are kept relative to the x of its subtree root, like the offsets of the layout, so a subtree
+ * that is moved keeps its box: after TreeLayout::add_node only the boxes of the new nodes and of their ancestors
+ * change, and add_nodes() updates only those.
+ *
+ * @tparam NodeType The node type of the tree
+ */
+template <typename NodeType>
+class LayoutIndex {
+private:
+    static constexpr uint32_t NO_NODE = TreeLayout<NodeType>::NO_NODE;
+
+    /**
+     * The box around the node centers of a subtree, left and right from the x of its root
+     */
+    struct Extent {
+        float left;
+        float right;
+        float bottom;
+    };
+
+    const TreeLayout<NodeType> *layout;
+    vector<Extent> extents; // The box of every subtree
+
+    static bool overlaps(const LayoutBounds &a, const LayoutBounds &b) {
+        return a.left <= b.right && b.left <= a.right && a.top <= b.bottom && b.top <= a.bottom;
+    }
+
+    // Grow the box of the parent of i by the box of i
+    void add_to_parent(size_t i) {
+        Extent &up = extents[layout->parent(i)];
+        const Extent &box = extents[i];
+        float offset = static_cast<float>(layout->offset(i));
+        up.left = min(up.left, offset + box.left);
+        up.right = max(up.right, offset + box.right);
+        up.bottom = max(up.bottom, box.bottom);
+    }
+
+public:
+    /**
+     * Constructs an empty index
+     */
+    LayoutIndex() : layout(nullptr) {}
+
+    /**
+     * Indexes a layout, in linear time
+     *
+     * @param layout The layout, it must not change (or be destroyed) until the next build, except by
+     *               TreeLayout::add_node with a call of add_nodes() after each one
+     */
+    void build(const TreeLayout<NodeType> &layout) {
+        this->layout = &layout;
+        size_t count = layout.size();
+
+        // Children have bigger numbers than their parents, so going backwards every subtree is done before its parent
+        extents.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            extents[i] = {0.f, 0.f, layout.y(i)};
+        }
+        for (size_t i = count; i-- > 1;) {
+            add_to_parent(i);
+        }
+    }
+
+    /**
+     * Indexes the nodes TreeLayout::add_node just added, and updates the boxes of their ancestors
+     * Costs the new nodes and the children of the ancestors, like the add_node
+     *
+     * @param first The number of the first new node, that add_node returned
+     */
+    void add_nodes(uint32_t first) {
+        size_t count = layout->size();
+        extents.resize(count);
+        for (size_t i = first; i < count; ++i) {
+            extents[i] = {0.f, 0.f, layout->y(i)};
+        }
+        for (size_t i = count; i-- > first + 1;) {
+            add_to_parent(i);
+        }
+
+        // The offsets of the children of every ancestor changed, so their boxes are made again from the children
+        for (uint32_t v = layout->parent(first); v != NO_NODE; v = layout->parent(v)) {
+            extents[v] = {0.f, 0.f, layout->y(v)};
+            for (uint32_t child = layout->first_child(v); child != NO_NODE; child = layout->next_sibling(child)) {
+                add_to_parent(child);
+            }
+        }
+    }
+
+    /**
+     * Calls f(number) for every node whose center is in an area, in no particular order
+     * The subtrees whose box is out of the area are skipped
+     *
+     * @param area The area
+     * @param f The function to call
+     */
+    template <typename F>
+    void for_each_in(const LayoutBounds &area, F &&f) const {
+        if (!layout || layout->size() == 0) {
+            return;
+        }
+
+        vector<uint32_t> stack{0};
+        while (!stack.empty()) {
+            uint32_t v = stack.back();
+            stack.pop_back();
+
+            if (!overlaps(subtree_bounds(v), area)) {
+                continue;
+            }
+
+            float x = layout->x(v), y = layout->y(v);
+            if (x >= area.left && x <= area.right && y >= area.top && y <= area.bottom) {
+                f(v);
+            }
+            for (uint32_t child = layout->first_child(v); child != NO_NODE; child = layout->next_sibling(child)) {
+                stack.push_back(child);
+            }
+        }
+    }
+
+    /**
+     * Walks the tree from the root for a zoomed out view: subtrees out of the area are skipped,
+     * and subtrees that are smaller than minSize both ways, with the size of a node around their box, are not opened.
+     * A chain of single children has no width, so it is judged by its larger side.
+     *
+     * The area is cut in cells of minSize and each cell opens at most one node, so deep trees seen from far away
+     * cost what fits in the area: a node in a cell that already has an opened node is a summary (or nothing for
+     * a leaf), and a summary whose subtree is in the box of the last summary of its cell is left out.
+     * The ancestors of the nodes in the area are reached with node() too, even when they are out of the area.
+     *
+     * @param area The area
+     * @param minSize The size under which a subtree is one summary, and the cell size (0 opens everything)
+     * @param nodeSize The size of a drawn node, added to the box of the node centers
+     * @param node Called with the number of every opened node (whose subtree is in the area)
+     * @param summary Called with the number of every subtree that is drawn as one summary
+     */
+    template <typename FNode, typename FSummary>
+    void for_each_level_of_detail(const LayoutBounds &area, float minSize, float nodeSize, FNode &&node, FSummary &&summary) const {
+        if (!layout || layout->size() == 0) {
+            return;
+        }
+
+        // The opened node and the last summary of every cell, with no cells if they would be too many
+        constexpr double MAX_CELLS = 1 << 22;
+        size_t cellColumns = 0;
+        vector<uint32_t> opened, summarized;
+        if (minSize > 0.f) {
+            double width = floor((area.right - area.left) / minSize) + 1, height = floor((area.bottom - area.top) / minSize) + 1;
+            if (width * height <= MAX_CELLS) {
+                cellColumns = static_cast<size_t>(width);
+                opened.assign(cellColumns * static_cast<size_t>(height), NO_NODE);
+                summarized.assign(opened.size(), NO_NODE);
+            }
+        }
+
+        auto within = [minSize](const LayoutBounds &inner, const LayoutBounds &outer) {
+            return inner.left >= outer.left - minSize && inner.right <= outer.right + minSize && inner.bottom <= outer.bottom + minSize;
+        };
+
+        vector<uint32_t> stack{0};
+        while (!stack.empty()) {
+            uint32_t v = stack.back();
+            stack.pop_back();
+
+            LayoutBounds box = subtree_bounds(v);
+            if (!overlaps(box, area)) {
+                continue;
+            }
+
+            bool leaf = layout->first_child(v) == NO_NODE;
+            float x = layout->x(v), y = layout->y(v);
+            uint32_t *cellOpened = nullptr, *cellSummarized = nullptr;
+            if (!opened.empty() && x >= area.left && x <= area.right && y >= area.top && y <= area.bottom) {
+                size_t cell = static_cast<size_t>((y - area.top) / minSize) * cellColumns + static_cast<size_t>((x - area.left) / minSize);
+                cellOpened = &opened[cell];
+                cellSummarized = &summarized[cell];
+            }
+
+            bool crowded = cellOpened && *cellOpened != NO_NODE;
+            if (crowded && leaf) {
+                continue;
+            }
+
+            if (crowded || (!leaf && max(box.right - box.left, box.bottom - box.top) + nodeSize < minSize)) {
+                if (cellSummarized) {
+                    if (*cellSummarized != NO_NODE && within(box, subtree_bounds(*cellSummarized))) {
+                        continue;
+                    }
+                    *cellSummarized = v;
+                }
+                summary(v);
+                continue;
+            }
+
+            node(v);
+            if (cellOpened) {
+                *cellOpened = v;
+            }
+            for (uint32_t child = layout->first_child(v); child != NO_NODE; child = layout->next_sibling(child)) {
+                stack.push_back(child);
+            }
+        }
+    }
+
+    /**
+     * Returns the box around the node centers of a subtree
+     *
+     * @param i The number of the subtree root
+     * @return LayoutBounds The box
+     */
+    LayoutBounds subtree_bounds(size_t i) const {
+        float x = layout->x(i);
+        return {x + extents[i].left, layout->y(i), x + extents[i].right, extents[i].bottom};
+    }
+};
+
+#endif // LAYOUT_INDEX_HPP
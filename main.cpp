@@ -2,14 +2,20 @@
 
 #include <iostream>
 #include <string>
-#include <functional>
-#include <map>
-#include <sstream>
+#include <cctype>
+#include <cstdlib>
+#include <atomic>
 #include <SFML/Graphics.hpp>
+#include <unistd.h>
 
 #include "node.hpp"
 #include "tree.hpp"
 #include "complex.hpp"
+#include "traversal_writer.hpp"
+#include "tree_snapshot.hpp"
+#include "tree_renderer.hpp"
+#include "frame_stats.hpp"
+#include "window_waker.hpp"
 
 using namespace std;
 
@@ -22,16 +28,8 @@ using namespace std;
 template <typename T>
 void display_tree(Tree<T>& tree, const string& title) {
 
-    // Consts to define visual of the tree
-    const float NODE_RADIUS = 50.f;
-    const float VERTICAL_SPACING = 200.f;
-    const float INITIAL_HORIZONTAL_SPACING = 250.f;
-
-    const sf::Color NODE_COLOR = sf::Color(173, 216, 230); 
-    const sf::Color LINE_COLOR = sf::Color::Black;
-    const sf::Color TEXT_COLOR = sf::Color::Black;
-    const sf::Color BACKGROUND_COLOR = sf::Color::White;
-    const unsigned FONT_SIZE = 20;
+    // The look of the tree (node size, spacing, colors and font size)
+    const RenderStyle STYLE;
     
     // Create the window that the tree will appear on and set the font
     // If it can't reach the font - you will not be able to watch the tree in a visual way (only prints in the terminal)
@@ -44,141 +42,187 @@ void display_tree(Tree<T>& tree, const string& title) {
         return;
     }
 
-    // Map that stores the position of each node
-    map<Node<T>*, sf::Vector2f> node_positions;
-
-    /** 
-     * Recuresive function that calculate and store the positions of nodes
-     */
-    function<void(Node<T>*, float, float, float)> calculate_positions = [&](Node<T>* node, float x, float y, float horizontal_spacing) {
-        if (!node) return;
-
-        node_positions[node] = sf::Vector2f(x, y);
-        const auto& children = node->get_children();
-        float child_x_offset = x - (children.size() - 1) * horizontal_spacing / 2.f;
+    // Draws the tree in a few draw calls, only what is in the view
+    // The root is at (0, 0) of the layout, the view starts with it at the top center of the window
+    TreeRenderer<Tree<T>> renderer(tree, font, STYLE);
+    sf::Vector2f windowSize(static_cast<float>(window.getSize().x), static_cast<float>(window.getSize().y));
+    const sf::Vector2f START(0.f, windowSize.y / 2.f - (STYLE.nodeRadius + 50.f));
+    sf::View view(START, windowSize);
+
+    // The mouse wheel and +/- zoom (at the cursor for the wheel), dragging and the arrows move,
+    // Home goes back to the start and a click on a node shows its value in the title
+    bool dragging = false;
+    bool dragged = false;
+    sf::Vector2i dragFrom;
+
+    auto zoom_at = [&](sf::Vector2i pixel, float factor) {
+        sf::Vector2f before = window.mapPixelToCoords(pixel, view);
+        view.zoom(factor);
+        sf::Vector2f after = window.mapPixelToCoords(pixel, view);
+        view.move(before - after);
+    };
 
-        for (size_t i = 0; i < children.size(); ++i) {
-            Node<T>* child = children[i];
-            if (child) {
-                calculate_positions(child, child_x_offset + i * horizontal_spacing, y + VERTICAL_SPACING, horizontal_spacing / 2.f);
+    // true when the window must be drawn again even if the view and the tree did not change
+    bool dirty = true;
+
+    auto handle_event = [&](const sf::Event& event) {
+        if (event.type == sf::Event::Closed) {
+            window.close();
+        } else if (event.type == sf::Event::GainedFocus || event.type == sf::Event::MouseEntered) {
+            // The window may have been covered
+            dirty = true;
+        } else if (event.type == sf::Event::Resized) {
+            dirty = true;
+
+            // Keep the zoom, show more or less of the tree
+            float zoom = view.getSize().x / windowSize.x;
+            windowSize = sf::Vector2f(static_cast<float>(event.size.width), static_cast<float>(event.size.height));
+            view.setSize(windowSize * zoom);
+        } else if (event.type == sf::Event::MouseWheelScrolled) {
+            zoom_at(sf::Vector2i(event.mouseWheelScroll.x, event.mouseWheelScroll.y), event.mouseWheelScroll.delta > 0 ? 0.8f : 1.25f);
+        } else if (event.type == sf::Event::MouseButtonPressed && event.mouseButton.button == sf::Mouse::Left) {
+            dragging = true;
+            dragged = false;
+            dragFrom = sf::Vector2i(event.mouseButton.x, event.mouseButton.y);
+        } else if (event.type == sf::Event::MouseMoved && dragging) {
+            sf::Vector2i to(event.mouseMove.x, event.mouseMove.y);
+            view.move(window.mapPixelToCoords(dragFrom, view) - window.mapPixelToCoords(to, view));
+            dragged = dragged || abs(to.x - dragFrom.x) + abs(to.y - dragFrom.y) > 3;
+            dragFrom = to;
+        } else if (event.type == sf::Event::MouseButtonReleased && event.mouseButton.button == sf::Mouse::Left) {
+            dragging = false;
+            if (!dragged) {
+                const Node<T>* node = renderer.node_at(window.mapPixelToCoords(sf::Vector2i(event.mouseButton.x, event.mouseButton.y), view));
+                window.setTitle(node ? title + " - " + node_label(node->get_value()) : title);
+            }
+        } else if (event.type == sf::Event::KeyPressed) {
+            sf::Vector2f step = view.getSize() * 0.1f;
+            switch (event.key.code) {
+            case sf::Keyboard::Left: view.move(-step.x, 0.f); break;
+            case sf::Keyboard::Right: view.move(step.x, 0.f); break;
+            case sf::Keyboard::Up: view.move(0.f, -step.y); break;
+            case sf::Keyboard::Down: view.move(0.f, step.y); break;
+            case sf::Keyboard::Add:
+            case sf::Keyboard::Equal: zoom_at(sf::Vector2i(window.getSize() / 2u), 0.8f); break;
+            case sf::Keyboard::Subtract:
+            case sf::Keyboard::Hyphen: zoom_at(sf::Vector2i(window.getSize() / 2u), 1.25f); break;
+            case sf::Keyboard::Home: view = sf::View(START, windowSize); break;
+            default: break;
             }
         }
     };
 
-    calculate_positions(tree.get_root(), window.getSize().x / 2.f, NODE_RADIUS + 50.f, INITIAL_HORIZONTAL_SPACING);
+    // A change of the tree wakes the window, even when it comes from another thread.
+    // The flag hands the change over to this thread, which reads the tree only after it sees the flag.
+    atomic<bool> treeChanged(false);
+    WindowWaker waker(window.getSystemHandle());
+    tree.set_change_listener([&] {
+        treeChanged.store(true, memory_order_release);
+        waker.wake();
+    });
 
-     
     // Main loop that handles the show of each tree on the window
-    // It Draws the nodes, lines between nodes, and node text.
+    // It sleeps in waitEvent until something happens (an event, or a change of the tree that wakes it),
+    // handles all the waiting events at once, and draws the nodes, lines between nodes, and node text
+    // only if the view, the window or the tree (its version) changed.
+    // Another thread may change the tree between frames, but not while a frame is drawn - the tree is not locked.
+    FrameStats stats;
     while (window.isOpen()) {
         sf::Event event;
+        if (!dirty) {
+            if (!window.waitEvent(event)) break;
+            stats.wake();
+            handle_event(event);
+        }
         while (window.pollEvent(event)) {
-            if (event.type == sf::Event::Closed) window.close();
+            handle_event(event);
         }
+        if (!window.isOpen()) break;
+
+        treeChanged.exchange(false, memory_order_acquire);
+        if (!dirty && renderer.is_current(view, window.getSize())) continue;
+
+        stats.begin_frame();
+        renderer.update();
+        renderer.set_view(view, window.getSize());
+        window.setView(view);
+        window.clear(STYLE.backgroundColor);
+        window.draw(renderer);
+        stats.end_frame();
+        window.display();
+        dirty = false;
+    }
 
-        window.clear(BACKGROUND_COLOR);
-
-        for (const auto& [node, position] : node_positions) {
-            // Draw node
-            sf::CircleShape circle(NODE_RADIUS);
-            circle.setFillColor(NODE_COLOR);
-            circle.setOutlineColor(LINE_COLOR);
-            circle.setOutlineThickness(3.f);
-            circle.setPosition(position - sf::Vector2f(NODE_RADIUS, NODE_RADIUS));
-            window.draw(circle);
-
-            // Draw text
-            sf::Text text;
-            text.setFont(font);
-            text.setStyle(sf::Text::Bold);
-            text.setCharacterSize(FONT_SIZE);
-            text.setFillColor(TEXT_COLOR);
-
-            if constexpr (is_same<T, string>::value) {
-                text.setString(node->get_value());
-            } else if constexpr (is_same<T, Complex>::value) {
-                ostringstream oss;
-                oss << node->get_value();
-                text.setString(oss.str());
-            } else {
-                text.setString(to_string(node->get_value()));
-            }
+    tree.set_change_listener(nullptr);
 
-            sf::FloatRect text_bounds = text.getLocalBounds();
-            text.setOrigin(text_bounds.left + text_bounds.width / 2.f, text_bounds.top + text_bounds.height / 2.f);
-            text.setPosition(position);
-            window.draw(text);
-
-            // Draw lines to children
-            for (Node<T>* child : node->get_children()) {
-                if (child) {
-                    sf::Vector2f child_position = node_positions[child];
-                    sf::Vertex line[] = {
-                        sf::Vertex(position, LINE_COLOR),
-                        sf::Vertex(child_position, LINE_COLOR)
-                    };
-                    window.draw(line, 2, sf::Lines);
-                }
-            }
-        }
+    cout << title << ": " << stats.frame_count() << " frames for " << stats.wakeup_count() << " wake ups (last " << stats.last_ms()
+         << " ms, average " << stats.average_ms() << " ms, slowest " << stats.slowest_ms() << " ms)" << endl;
+}
 
-        window.display();
+/** 
+ * Function that shows a tree in a window, or saves it as an SVG snapshot in headless mode
+ * 
+ * @param snapshots The snapshot writer in headless mode, nullptr to open a window
+ * @param directory The directory of the snapshots
+ */
+template <typename T>
+void show_tree(Tree<T>& tree, const string& title, TreeSnapshotWriter* snapshots, const string& directory) {
+    if (!snapshots) {
+        display_tree(tree, title);
+        return;
+    }
+
+    // "3-ary Double Tree" is saved as 3_ary_double_tree.svg
+    string name;
+    for (char c : title) {
+        name += isalnum(static_cast<unsigned char>(c)) ? static_cast<char>(tolower(static_cast<unsigned char>(c))) : '_';
     }
+    string path = directory + "/" + name + ".svg";
+
+    SnapshotTiming timing = snapshots->save(tree, path);
+    cout << "Saved " << path << " (layout " << timing.layoutMs << " ms, render " << timing.renderMs
+         << " ms, write " << timing.writeMs << " ms, " << timing.bytes << " bytes)" << endl;
 }
 
 /** 
  * Function that prints the results of different tree traversals.
  * It prints pre-order, post-order, in-order, and BFS traversals.
+ * The values go through a TraversalWriter, so a big tree is printed with one write per chunk and not per value.
  */
 template <typename T>
 void print_traversals(Tree<T>& tree, string title) {
-    auto print_traversal = [](const string& title, auto begin, auto end) {
-        cout << "############ " << title << " ############" << endl;
-        bool first = true;
-        for (auto node = begin; node != end; ++node) {
-            if (!first) {
-                cout << ", " << flush;
-            }
-            cout << node->get_value() << flush;
-            first = false;
-        }
-        cout << "\n\n";
-    };
-
     cout << "################################################ " << title << " ################################################" << endl;
-    print_traversal("Pre-order traversal:", tree.begin_pre_order(), tree.end_pre_order());
-    print_traversal("Post-order traversal:", tree.begin_post_order(), tree.end_post_order());
-    print_traversal("In-order traversal:", tree.begin_in_order(), tree.end_in_order());
-    print_traversal("BFS traversal:", tree.begin_bfs_scan(), tree.end_bfs_scan());
 
-     
-    // Show range-based for loop for BFS traversal. 
-    cout << "############ Default BFS Iterator:: ############" << endl;
-    bool first = true;
-    for (const auto& node : tree) {
-        if (!first) {
-            cout << ", " << flush;
-        }
-        cout << node.get_value() << flush;
-        first = false;
-    }
-    cout << "\n\n";
+    TraversalWriter writer(STDOUT_FILENO);
+    writer.write_traversal("Pre-order traversal:", tree.begin_pre_order(), tree.end_pre_order());
+    writer.write_traversal("Post-order traversal:", tree.begin_post_order(), tree.end_post_order());
+    writer.write_traversal("In-order traversal:", tree.begin_in_order(), tree.end_in_order());
+    writer.write_traversal("BFS traversal:", tree.begin_bfs_scan(), tree.end_bfs_scan());
+
+    // Show the default BFS iterator (the one range-based for loops use).
+    writer.write_traversal("Default BFS Iterator::", tree.begin(), tree.end());
+    writer.flush();
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    // With --headless [directory], or with no display to open windows on, the trees are saved as SVG snapshots
+    bool headless = (argc > 1 && string(argv[1]) == "--headless") || (!getenv("DISPLAY") && !getenv("WAYLAND_DISPLAY"));
+    string directory = argc > 2 ? argv[2] : ".";
+    TreeSnapshotWriter snapshotWriter;
+    TreeSnapshotWriter* snapshots = headless ? &snapshotWriter : nullptr;
      
     // Examples that shows tree operations with double values.
     // Creates nodes, sets up a tree structure, and displays it.
-    Node<double>* root_node = new Node<double>(1.1);
     Tree<double> double_tree;
+    Node<double>* root_node = &double_tree.create_node(1.1);
 
     double_tree.add_root(*root_node);
     
-    Node<double>* n1 = new Node<double>(1.2);
-    Node<double>* n2 = new Node<double>(1.3);
-    Node<double>* n3 = new Node<double>(1.4);
-    Node<double>* n4 = new Node<double>(1.5);
-    Node<double>* n5 = new Node<double>(1.6);
+    Node<double>* n1 = &double_tree.create_node(1.2);
+    Node<double>* n2 = &double_tree.create_node(1.3);
+    Node<double>* n3 = &double_tree.create_node(1.4);
+    Node<double>* n4 = &double_tree.create_node(1.5);
+    Node<double>* n5 = &double_tree.create_node(1.6);
 
     double_tree.add_sub_node(*root_node, *n1);
     double_tree.add_sub_node(*root_node, *n2);
@@ -187,21 +231,21 @@ int main() {
     double_tree.add_sub_node(*n2, *n5);
 
     string title = "Double Tree";
-    display_tree(double_tree, title);
+    show_tree(double_tree, title, snapshots, directory);
     print_traversals(double_tree, title);
 
 
     // Create a new root node and structure for a 3-ary tree and disaplay it
-    Node<double>* sec_root_node = new Node<double>(1.1);
     Tree<double> three_ary_tree(3);
+    Node<double>* sec_root_node = &three_ary_tree.create_node(1.1);
 
     three_ary_tree.add_root(*sec_root_node);
 
-    Node<double>* sec_n1 = new Node<double>(1.2);
-    Node<double>* sec_n2 = new Node<double>(1.3);
-    Node<double>* sec_n3 = new Node<double>(1.4);
-    Node<double>* sec_n4 = new Node<double>(1.5);
-    Node<double>* sec_n5 = new Node<double>(1.6);
+    Node<double>* sec_n1 = &three_ary_tree.create_node(1.2);
+    Node<double>* sec_n2 = &three_ary_tree.create_node(1.3);
+    Node<double>* sec_n3 = &three_ary_tree.create_node(1.4);
+    Node<double>* sec_n4 = &three_ary_tree.create_node(1.5);
+    Node<double>* sec_n5 = &three_ary_tree.create_node(1.6);
 
     three_ary_tree.add_sub_node(*sec_root_node, *sec_n1);
     three_ary_tree.add_sub_node(*sec_root_node, *sec_n2);
@@ -210,22 +254,22 @@ int main() {
     three_ary_tree.add_sub_node(*sec_n2, *sec_n5);
 
     title = "3-ary Double Tree";
-    display_tree(three_ary_tree, title);
+    show_tree(three_ary_tree, title, snapshots, directory);
     print_traversals(three_ary_tree, title);
 
      
     // Example that shows tree operations with Complex values
     // Creates nodes, sets up a tree structure, and displays it
-    Node<Complex>* third_root_node = new Node<Complex>(Complex(1.0, 1.0));
     Tree<Complex> complex_tree;
+    Node<Complex>* third_root_node = &complex_tree.create_node(Complex(1.0, 1.0));
 
     complex_tree.add_root(*third_root_node);
 
-    Node<Complex>* third_n1 = new Node<Complex>(Complex(2.0, 3.0));
-    Node<Complex>* third_n2 = new Node<Complex>(Complex(3.0, 4.0));
-    Node<Complex>* third_n3 = new Node<Complex>(Complex(4.0, 5.0));
-    Node<Complex>* third_n4 = new Node<Complex>(Complex(5.0, 6.0));
-    Node<Complex>* third_n5 = new Node<Complex>(Complex(6.0, 7.0));
+    Node<Complex>* third_n1 = &complex_tree.create_node(Complex(2.0, 3.0));
+    Node<Complex>* third_n2 = &complex_tree.create_node(Complex(3.0, 4.0));
+    Node<Complex>* third_n3 = &complex_tree.create_node(Complex(4.0, 5.0));
+    Node<Complex>* third_n4 = &complex_tree.create_node(Complex(5.0, 6.0));
+    Node<Complex>* third_n5 = &complex_tree.create_node(Complex(6.0, 7.0));
 
     complex_tree.add_sub_node(*third_root_node, *third_n1);
     complex_tree.add_sub_node(*third_root_node, *third_n2);
@@ -234,20 +278,20 @@ int main() {
     complex_tree.add_sub_node(*third_n2, *third_n5);
 
     title = "Complex Tree";
-    display_tree(complex_tree, title);
+    show_tree(complex_tree, title, snapshots, directory);
     print_traversals(complex_tree, title);
 
     // Create a new root node and structure for a 3-ary complex tree and disaplay it
-    Node<Complex>* forth_root_node = new Node<Complex>(Complex(1.0, 1.0));
     Tree<Complex> three_ary_complex_tree(3);
+    Node<Complex>* forth_root_node = &three_ary_complex_tree.create_node(Complex(1.0, 1.0));
 
     three_ary_complex_tree.add_root(*forth_root_node);
 
-    Node<Complex>* forth_n1 = new Node<Complex>(Complex(2.0, 3.0));
-    Node<Complex>* forth_n2 = new Node<Complex>(Complex(3.0, 4.0));
-    Node<Complex>* forth_n3 = new Node<Complex>(Complex(4.0, 5.0));
-    Node<Complex>* forth_n4 = new Node<Complex>(Complex(5.0, 6.0));
-    Node<Complex>* forth_n5 = new Node<Complex>(Complex(6.0, 7.0));
+    Node<Complex>* forth_n1 = &three_ary_complex_tree.create_node(Complex(2.0, 3.0));
+    Node<Complex>* forth_n2 = &three_ary_complex_tree.create_node(Complex(3.0, 4.0));
+    Node<Complex>* forth_n3 = &three_ary_complex_tree.create_node(Complex(4.0, 5.0));
+    Node<Complex>* forth_n4 = &three_ary_complex_tree.create_node(Complex(5.0, 6.0));
+    Node<Complex>* forth_n5 = &three_ary_complex_tree.create_node(Complex(6.0, 7.0));
 
     three_ary_complex_tree.add_sub_node(*forth_root_node, *forth_n1);
     three_ary_complex_tree.add_sub_node(*forth_root_node, *forth_n2);
@@ -256,8 +300,13 @@ int main() {
     three_ary_complex_tree.add_sub_node(*forth_n2, *forth_n5);
 
     title = "3-ary Complex Tree";
-    display_tree(three_ary_complex_tree, title);
+    show_tree(three_ary_complex_tree, title, snapshots, directory);
     print_traversals(three_ary_complex_tree, title);
 
+    if (headless) {
+        cout << snapshotWriter.frame_count() << " snapshots in " << snapshotWriter.total_ms() << " ms (slowest "
+             << snapshotWriter.slowest_ms() << " ms)" << endl;
+    }
+
     return 0;
 }
@@ -4,23 +4,103 @@
 #define NODE_HPP
 
 #include <vector>
+#include <array>
+#include <iterator>
 #include <stdexcept>
+#include <utility>
 
 using namespace std;
 
+// Arity for nodes (and trees) where the number of children is only known at runtime
+constexpr size_t dynamic_arity = 0;
+
+/**
+ * A read-only view over the children of a node
+ * 
+ * It works like a const vector of child pointers (size, [], begin/end, rbegin/rend),
+ * no matter how the node stores its children.
+ * 
+ * @tparam N The node type
+ */
+template <typename N>
+class ChildSpan {
+private:
+    N *const *first; // Pointer to the first child pointer
+    size_t count;    // Number of children
+
+public:
+    using value_type = N *;
+    using const_iterator = N *const *;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    ChildSpan(N *const *first, size_t count) : first(first), count(count) {}
+
+    const_iterator begin() const { return first; }
+    const_iterator end() const { return first + count; }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    N *operator[](size_t i) const { return first[i]; }
+    N *front() const { return first[0]; }
+    N *back() const { return first[count - 1]; }
+};
+
+/**
+ * The children storage of a node with a known arity
+ * 
+ * The child pointers are kept inside the node itself, so there is no extra allocation per node.
+ * 
+ * @tparam N The node type
+ * @tparam K The maximum number of children
+ */
+template <typename N, size_t K>
+class ChildStorage {
+private:
+    array<N *, K> items; // The child pointers, only the first count are used
+    size_t count;        // Number of children
+
+public:
+    ChildStorage() : count(0) {}
+
+    static constexpr size_t capacity() { return K; }
+    size_t size() const { return count; }
+    N *const *data() const { return items.data(); }
+    void push_back(N *child) { items[count++] = child; }
+};
+
+/**
+ * The children storage of a node with a runtime arity, the child pointers are kept in a vector
+ * 
+ * @tparam N The node type
+ */
+template <typename N>
+class ChildStorage<N, dynamic_arity> {
+private:
+    vector<N *> items; // The child pointers
+
+public:
+    static constexpr size_t capacity() { return static_cast<size_t>(-1); }
+    size_t size() const { return items.size(); }
+    N *const *data() const { return items.data(); }
+    void push_back(N *child) { items.push_back(child); }
+};
+
 /**
  * A template class for tree nodes
  * 
  * @tparam T The type of the value stored in the node
+ * @tparam K The maximum number of children stored inline in the node, or dynamic_arity (the default) to keep them in a vector
  */
-template <typename T>
+template <typename T, size_t K = dynamic_arity>
 
 class Node {
 private:
     // The value of the current node
     T value; 
-    // Vector of child node pointers
-    vector<Node*> children; 
+    // The child node pointers
+    ChildStorage<Node, K> children; 
 public:
     /**
      * Constructs a node with a given value
@@ -38,16 +118,26 @@ public:
         return value;
     }
 
+    /**
+     * Swaps the values of two nodes, the children stay where they are
+     * 
+     * @param other The node to swap values with
+     */
+    void swap_value(Node& other) {
+        using std::swap;
+        swap(value, other.value);
+    }
+
     /**
      * Adds a child node, ensuring the maximum number is not exceeded
      * 
      * @param child Pointer to the child node
      * @param k Maximum number of children allowed
      * 
-     * @throws runtime_error if the maximum number is exceeded
+     * @throws runtime_error if the maximum number (or the inline capacity of the node) is exceeded
      */
     void add_sub_node(Node* child, size_t k) {
-        if (children.size() >= k) {
+        if (children.size() >= k || children.size() >= children.capacity()) {
             throw runtime_error("############ Error: Too much children... ############");
         }
         children.push_back(child);
@@ -56,10 +146,10 @@ public:
     /**
      * Returns the node's children
      * 
-     * @return const vector<Node*>& Vector of child node pointers
+     * @return ChildSpan<Node> View of the child node pointers
      */
-    const vector<Node*>& get_children() const {
-        return children;
+    ChildSpan<Node> get_children() const {
+        return ChildSpan<Node>(children.data(), children.size());
     }
 };
 
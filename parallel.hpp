@@ -0,0 +1,321 @@
+// noavrd@gmail.com
+
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <exception>
+
+using namespace std;
+
+/**
+ * The orders of parallel_for_each
+ *
+ * unordered - every node is visited once, in no particular order (for commutative work)
+ * post_order - every node is visited after all of its children (for bottom-up aggregation)
+ */
+enum class ParallelOrder {
+    unordered,
+    post_order
+};
+
+/**
+ * The number of threads parallel_for_each uses by default
+ *
+ * @return The number of hardware threads, at least 1
+ */
+inline size_t default_thread_count() {
+    size_t threads = thread::hardware_concurrency();
+    return threads > 0 ? threads : 1;
+}
+
+/**
+ * ParallelTraversal class template
+ *
+ * The work-stealing engine behind parallel_for_each.
+ * Every worker has its own deque of subtree tasks: it takes from the back of its own deque,
+ * and when it is empty it steals from the front of the others, where the biggest subtrees are.
+ *
+ * A worker walks its subtree with a local stack, like for_each_pre_order / for_each_post_order, and only
+ * splits it into tasks when another worker is idle, so a busy pool costs one atomic load per node.
+ *
+ * In post-order, a node that was split keeps a frame with the number of children that are not done yet,
+ * and the worker that finishes its last child visits it.
+ *
+ * @tparam N The node type
+ * @tparam F The function type
+ */
+template <typename N, typename F>
+class ParallelTraversal {
+private:
+    // A node of post-order that waits for its children
+    struct Frame {
+        N *node;                // The node to visit when its children are done
+        Frame *parent;          // The frame of its parent, or nullptr
+        atomic<size_t> pending; // Number of children that are not done yet
+
+        Frame(N *node, Frame *parent, size_t pending) : node(node), parent(parent), pending(pending) {}
+    };
+
+    // A subtree to traverse, and the frame to tell when it is done (post-order only)
+    struct Task {
+        N *node;
+        Frame *parent;
+    };
+
+    // The tasks of one worker, on its own cache line
+    struct alignas(64) WorkerQueue {
+        mutex lock;
+        deque<Task> tasks;
+        deque<Frame> frames; // Frames made by this worker, freed together at the end
+    };
+
+    F &visit;
+    ParallelOrder order;
+    size_t threads;
+    vector<WorkerQueue> queues;
+    atomic<size_t> outstanding; // Tasks that were pushed and are not done yet
+    atomic<size_t> idle;        // Workers that are looking for work
+    atomic<bool> failed;        // Set when visit threw, so the workers stop
+    exception_ptr error;
+    mutex errorLock;
+
+    void push_task(size_t worker, const Task &task) {
+        outstanding.fetch_add(1, memory_order_relaxed);
+        lock_guard<mutex> guard(queues[worker].lock);
+        queues[worker].tasks.push_back(task);
+    }
+
+    bool pop_task(size_t worker, Task &task) {
+        lock_guard<mutex> guard(queues[worker].lock);
+        if (queues[worker].tasks.empty()) {
+            return false;
+        }
+
+        task = queues[worker].tasks.back();
+        queues[worker].tasks.pop_back();
+        return true;
+    }
+
+    bool steal_task(size_t worker, Task &task) {
+        for (size_t i = 1; i < threads; ++i) {
+            WorkerQueue &victim = queues[(worker + i) % threads];
+            lock_guard<mutex> guard(victim.lock);
+
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Tell a frame that one of its children is done, and visit the frames that have no children left
+    void finish_child(Frame *frame) {
+        while (frame && frame->pending.fetch_sub(1, memory_order_acq_rel) == 1) {
+            visit(*frame->node);
+            frame = frame->parent;
+        }
+    }
+
+    // Visit a subtree in any order, giving the nodes on the stack to the idle workers
+    void run_unordered(size_t worker, N *start, vector<N *> &nodes) {
+        nodes.clear();
+        nodes.push_back(start);
+
+        while (!nodes.empty()) {
+            if (nodes.size() > 1 && idle.load(memory_order_relaxed) > 0) {
+                for (size_t i = 0; i + 1 < nodes.size(); ++i) {
+                    push_task(worker, Task{nodes[i], nullptr});
+                }
+                nodes.erase(nodes.begin(), nodes.end() - 1);
+            }
+
+            N *node = nodes.back();
+            nodes.pop_back();
+            visit(*node);
+
+            const auto &children = node->get_children();
+            for (auto child = children.rbegin(); child != children.rend(); ++child) {
+                if (*child != nullptr) {
+                    nodes.push_back(*child);
+                }
+            }
+        }
+    }
+
+    // Turn the local post-order stack into frames, and the children it did not start yet into tasks
+    void split_post_order(size_t worker, Frame *parent, vector<pair<N *, size_t>> &frames) {
+        vector<Frame *> made;
+
+        for (size_t i = 0; i < frames.size(); ++i) {
+            const auto &children = frames[i].first->get_children();
+            bool top = i + 1 == frames.size();
+            size_t pending = top ? 0 : 1; // The child on the stack above is in progress
+
+            for (size_t c = frames[i].second; c < children.size(); ++c) {
+                if (children[c] != nullptr) {
+                    ++pending;
+                }
+            }
+
+            queues[worker].frames.emplace_back(frames[i].first, parent, pending);
+            parent = &queues[worker].frames.back();
+            made.push_back(parent);
+        }
+
+        // Only push the tasks once all the frames are ready
+        for (size_t i = 0; i < frames.size(); ++i) {
+            const auto &children = frames[i].first->get_children();
+
+            for (size_t c = frames[i].second; c < children.size(); ++c) {
+                if (children[c] != nullptr) {
+                    push_task(worker, Task{children[c], made[i]});
+                }
+            }
+        }
+
+        frames.clear();
+    }
+
+    // Visit a subtree in post-order, splitting it when another worker is idle
+    void run_post_order(size_t worker, const Task &task, vector<pair<N *, size_t>> &frames) {
+        frames.clear();
+        frames.emplace_back(task.node, 0);
+
+        while (!frames.empty()) {
+            auto &frame = frames.back();
+            const auto &children = frame.first->get_children();
+
+            // Skip missing children
+            while (frame.second < children.size() && children[frame.second] == nullptr) {
+                ++frame.second;
+            }
+
+            if (frame.second < children.size()) {
+                if (frame.second + 1 < children.size() && idle.load(memory_order_relaxed) > 0) {
+                    // The subtree is done by the frames now, not by this task
+                    split_post_order(worker, task.parent, frames);
+                    return;
+                }
+
+                N *child = children[frame.second++];
+                frames.emplace_back(child, 0);
+            } else {
+                N *node = frame.first;
+                frames.pop_back();
+                visit(*node);
+            }
+        }
+
+        finish_child(task.parent);
+    }
+
+    void run_worker(size_t worker) {
+        vector<N *> nodes;
+        vector<pair<N *, size_t>> frames;
+        bool isIdle = false;
+
+        while (true) {
+            Task task;
+
+            if (pop_task(worker, task) || steal_task(worker, task)) {
+                if (isIdle) {
+                    idle.fetch_sub(1, memory_order_relaxed);
+                    isIdle = false;
+                }
+
+                if (!failed.load(memory_order_relaxed)) {
+                    try {
+                        if (order == ParallelOrder::post_order) {
+                            run_post_order(worker, task, frames);
+                        } else {
+                            run_unordered(worker, task.node, nodes);
+                        }
+                    } catch (...) {
+                        lock_guard<mutex> guard(errorLock);
+                        if (!error) {
+                            error = current_exception();
+                        }
+                        failed.store(true, memory_order_relaxed);
+                    }
+                }
+
+                outstanding.fetch_sub(1, memory_order_acq_rel);
+            } else if (outstanding.load(memory_order_acquire) == 0) {
+                break;
+            } else {
+                if (!isIdle) {
+                    idle.fetch_add(1, memory_order_relaxed);
+                    isIdle = true;
+                }
+                this_thread::yield();
+            }
+        }
+
+        if (isIdle) {
+            idle.fetch_sub(1, memory_order_relaxed);
+        }
+    }
+
+public:
+    ParallelTraversal(F &visit, ParallelOrder order, size_t threads)
+        : visit(visit), order(order), threads(threads > 0 ? threads : 1), queues(this->threads),
+          outstanding(0), idle(0), failed(false) {}
+
+    /**
+     * Visit the subtree of a node with all the workers, the calling thread being one of them
+     *
+     * @param root The root of the subtree, or nullptr
+     *
+     * @throws The first exception thrown by the function, after all the workers stopped
+     */
+    void run(N *root) {
+        if (!root) { return; }
+
+        push_task(0, Task{root, nullptr});
+
+        vector<thread> workers;
+        for (size_t i = 1; i < threads; ++i) {
+            workers.emplace_back(&ParallelTraversal::run_worker, this, i);
+        }
+
+        run_worker(0);
+
+        for (auto &worker : workers) {
+            worker.join();
+        }
+
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+};
+
+/**
+ * Call a function on every node of a tree with a pool of threads
+ *
+ * The function is called from several threads at the same time, so it must be safe for that.
+ * In post-order, whatever a call did to the children of a node is visible to the call on the node.
+ *
+ * @param tree The tree to traverse
+ * @param visit The function to call, with a NodeType& argument
+ * @param order unordered, or post_order to visit every node after its children
+ * @param threads The number of threads, including the calling one
+ *
+ * @throws The first exception thrown by the function (the traversal stops early, so some nodes may not be visited)
+ */
+template <typename TreeType, typename F>
+void parallel_for_each(const TreeType &tree, F &&visit, ParallelOrder order = ParallelOrder::unordered,
+                       size_t threads = default_thread_count()) {
+    ParallelTraversal<typename TreeType::NodeType, F> traversal(visit, order, threads);
+    traversal.run(tree.get_root());
+}
+
+#endif // PARALLEL_HPP
@@ -5,10 +5,48 @@
 #include "doctest.h"
 #include "complex.hpp"
 #include "tree.hpp"
+#include "tree_file.hpp"
 #include "node.hpp"
+#include "parallel.hpp"
+#include "complex_array.hpp"
+#include "tree_csv.hpp"
+#include "traversal_writer.hpp"
+#include "tree_snapshot.hpp"
+#include "tree_layout.hpp"
+#include "layout_index.hpp"
+#include "frame_stats.hpp"
+
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <map>
+#include <cstdio>
+#include <unistd.h>
 
 using namespace std;
 
+// Counts the heap allocations, to check the traversals that should not allocate (atomic, since some tests use threads)
+static atomic<size_t> allocationCount(0);
+
+void *operator new(size_t size) {
+    ++allocationCount;
+    if (void *memory = malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    free(memory);
+}
+
 /*
  * A testing unit that will test each tree type with the preOrder, postOrder, inOrder, BFS, DFS interators
  * First it will create each tree according to the checked type and then it will use the iterators
@@ -385,3 +423,1710 @@ TEST_CASE("Testing exceeding maximum number of children") {
 
     REQUIRE_THROWS_AS(fifthTestTree.add_sub_node(root, n3), runtime_error);
 }
+
+// Testing adding children directly under a parent node and building from a parent index array
+TEST_CASE("Testing direct insertion and building from parents") {
+    Tree<int> sixthTestTree;
+
+    Node<int> root(1);
+    Node<int> n2(2);
+    Node<int> n3(3);
+    Node<int> n4(2);
+
+    // Two nodes with the same value - the child must go under the node that was passed
+    sixthTestTree.add_root(root);
+    sixthTestTree.add_sub_node_direct(root, n2);
+    sixthTestTree.add_sub_node_direct(root, n3);
+    sixthTestTree.add_sub_node_direct(n3, n4);
+
+    CHECK(n2.get_children().empty());
+    REQUIRE(n3.get_children().size() == 1);
+    CHECK(n3.get_children()[0] == &n4);
+
+    Node<int> n5(5);
+    REQUIRE_THROWS_AS(sixthTestTree.add_sub_node_direct(root, n5), runtime_error);
+
+    // Building the tree 1 -> (2 -> (4, 5), 3 -> 6) from parent indexes
+    Tree<int> seventhTestTree;
+    vector<Node<int>> values = {Node<int>(1), Node<int>(2), Node<int>(3), Node<int>(4), Node<int>(5), Node<int>(6)};
+    vector<Node<int> *> nodes;
+    for (auto &node : values) {
+        nodes.push_back(&node);
+    }
+
+    seventhTestTree.build_from_parents(nodes, {-1, 0, 0, 1, 1, 2});
+    CHECK(seventhTestTree.get_root() == nodes[0]);
+
+    vector<int> preOrder;
+    for (auto it = seventhTestTree.begin_pre_order(); it != seventhTestTree.end_pre_order(); ++it) {
+        preOrder.push_back(it->get_value());
+    }
+    CHECK(preOrder == vector<int>{1, 2, 4, 5, 3, 6});
+
+    Tree<int> eighthTestTree;
+    vector<Node<int>> badValues = {Node<int>(1), Node<int>(2)};
+    vector<Node<int> *> badNodes = {&badValues[0], &badValues[1]};
+    REQUIRE_THROWS_AS(eighthTestTree.build_from_parents(badNodes, {-1, -1}), runtime_error);
+    REQUIRE_THROWS_AS(eighthTestTree.build_from_parents(badNodes, {1, -1}), runtime_error);
+}
+
+// A hasher of complex numbers by their real part, for the index test
+struct RealPartHash {
+    size_t operator()(const Complex &c) const {
+        return hash<double>()(c.get_real());
+    }
+};
+
+// Testing the value index mode of the tree
+TEST_CASE("Testing tree index mode") {
+    Tree<string> ninthTestTree;
+
+    Node<string> root("root");
+    Node<string> left("same");
+    Node<string> right("same");
+    Node<string> rightLeft("right-left");
+
+    ninthTestTree.add_root(root);
+    ninthTestTree.add_sub_node(root, left);
+    CHECK(ninthTestTree.index_memory_usage() == 0);
+
+    // Nodes added before the index is turned on are indexed too
+    ninthTestTree.enable_index();
+    CHECK(ninthTestTree.is_indexed());
+    CHECK(ninthTestTree.find_node("same") == &left);
+
+    // With the index, the child goes under the node that was passed and not the first equal one
+    ninthTestTree.add_sub_node(root, right);
+    ninthTestTree.add_sub_node(right, rightLeft);
+    CHECK(left.get_children().empty());
+    REQUIRE(right.get_children().size() == 1);
+    CHECK(right.get_children()[0] == &rightLeft);
+
+    CHECK(ninthTestTree.find_node("right-left") == &rightLeft);
+    CHECK(ninthTestTree.find_node("missing") == nullptr);
+    CHECK(ninthTestTree.index_memory_usage() > 0);
+
+    ninthTestTree.disable_index();
+    CHECK(ninthTestTree.index_memory_usage() == 0);
+    CHECK(ninthTestTree.find_node("right-left") == &rightLeft);
+
+    // With equal values, the search finds the first in pre-order and the index finds one of them
+    CHECK(ninthTestTree.find_node("same") == &left);
+    ninthTestTree.enable_index();
+    Node<string> *same = ninthTestTree.find_node("same");
+    CHECK((same == &left || same == &right));
+    ninthTestTree.disable_index();
+
+    // Index with complex numbers and a custom hasher
+    Tree<Complex, dynamic_arity, NodeArena, RealPartHash> tenthTestTree(3);
+    Node<Complex> croot(Complex(1.0, 1.0));
+    Node<Complex> c1(Complex(2.0, 3.0));
+    Node<Complex> c2(Complex(3.0, 4.0));
+
+    tenthTestTree.add_root(croot);
+    tenthTestTree.enable_index();
+    tenthTestTree.add_sub_node(croot, c1);
+    tenthTestTree.add_sub_node_direct(c1, c2);
+    CHECK(tenthTestTree.find_node(Complex(3.0, 4.0)) == &c2);
+    CHECK(tenthTestTree.find_node(Complex(3.0, 5.0)) == nullptr);
+}
+
+// Testing trees that own their nodes with the arena and the heap allocators
+TEST_CASE("Testing tree owned nodes") {
+    Tree<string> eleventhTestTree;
+
+    Node<string> &root = eleventhTestTree.create_node("root");
+    eleventhTestTree.add_root(root);
+
+    // Enough nodes to need a few arena chunks
+    Node<string> *parent = &root;
+    for (int i = 0; i < 1000; ++i) {
+        Node<string> &child = eleventhTestTree.create_node("node" + to_string(i));
+        eleventhTestTree.add_sub_node_direct(*parent, child);
+        parent = &child;
+    }
+
+    CHECK(eleventhTestTree.owned_nodes() == 1001);
+
+    size_t count = 0;
+    for (auto it = eleventhTestTree.begin_pre_order(); it != eleventhTestTree.end_pre_order(); ++it) {
+        ++count;
+    }
+    CHECK(count == 1001);
+
+    eleventhTestTree.clear();
+    CHECK(eleventhTestTree.get_root() == nullptr);
+    CHECK(eleventhTestTree.owned_nodes() == 0);
+
+    // Building from values creates the nodes with the allocator
+    Tree<Complex, dynamic_arity, HeapAllocator> twelfthTestTree(3);
+    twelfthTestTree.build_from_parents(vector<Complex>{Complex(1.0, 1.0), Complex(2.0, 3.0), Complex(3.0, 4.0)}, {-1, 0, 0});
+    CHECK(twelfthTestTree.owned_nodes() == 3);
+    CHECK(twelfthTestTree.get_root()->get_value() == Complex(1.0, 1.0));
+    CHECK(twelfthTestTree.get_root()->get_children().size() == 2);
+
+    // Moving the tree moves the nodes ownership too
+    Tree<Complex, dynamic_arity, HeapAllocator> movedTree = move(twelfthTestTree);
+    CHECK(movedTree.owned_nodes() == 3);
+    CHECK(twelfthTestTree.owned_nodes() == 0);
+    CHECK(twelfthTestTree.get_root() == nullptr);
+    CHECK(movedTree.get_root()->get_children()[1]->get_value() == Complex(3.0, 4.0));
+
+    // Only the nodes created after a point are freed
+    movedTree.create_node(Complex(5.0, 5.0));
+    movedTree.create_node(Complex(6.0, 6.0));
+    movedTree.release_nodes_after(3);
+    CHECK(movedTree.owned_nodes() == 3);
+    CHECK(movedTree.get_root()->get_children()[0]->get_value() == Complex(2.0, 3.0));
+}
+
+// Testing trees with the children stored inline in the nodes
+TEST_CASE("Testing tree of inline nodes") {
+    Tree<int, 2> thirteenthTestTree;
+
+    Node<int, 2> root(1);
+    Node<int, 2> n2(2);
+    Node<int, 2> n3(3);
+    Node<int, 2> n4(4);
+    Node<int, 2> n5(5);
+    Node<int, 2> n6(6);
+
+    thirteenthTestTree.add_root(root);
+    thirteenthTestTree.add_sub_node(root, n2);
+    thirteenthTestTree.add_sub_node(root, n3);
+    thirteenthTestTree.add_sub_node(n2, n4);
+    thirteenthTestTree.add_sub_node(n2, n5);
+    thirteenthTestTree.add_sub_node(n3, n6);
+
+    vector<int> preOrder;
+    for (auto it = thirteenthTestTree.begin_pre_order(); it != thirteenthTestTree.end_pre_order(); ++it) {
+        preOrder.push_back(it->get_value());
+    }
+    CHECK(preOrder == vector<int>{1, 2, 4, 5, 3, 6});
+
+    vector<int> postOrder;
+    for (auto it = thirteenthTestTree.begin_post_order(); it != thirteenthTestTree.end_post_order(); ++it) {
+        postOrder.push_back(it->get_value());
+    }
+    CHECK(postOrder == vector<int>{4, 5, 2, 6, 3, 1});
+
+    Node<int, 2> n7(7);
+    REQUIRE_THROWS_AS(thirteenthTestTree.add_sub_node(root, n7), runtime_error);
+
+    // Inline nodes with a trivial value need no destructor, so the arena frees them without visiting them
+    CHECK(is_trivially_destructible<Node<int, 3>>::value);
+    CHECK(sizeof(Node<int, 3>) < sizeof(Node<int>) + 3 * sizeof(void *));
+
+    // The runtime limit can't be bigger than the inline capacity
+    REQUIRE_THROWS_AS((Tree<int, 3>(4)), runtime_error);
+
+    Tree<Complex, 3> fourteenthTestTree;
+    fourteenthTestTree.build_from_parents(vector<Complex>{Complex(1.0, 1.0), Complex(2.0, 3.0), Complex(3.0, 4.0), Complex(4.0, 5.0)}, {-1, 0, 0, 0});
+    REQUIRE(fourteenthTestTree.get_root()->get_children().size() == 3);
+    CHECK(fourteenthTestTree.get_root()->get_children().back()->get_value() == Complex(4.0, 5.0));
+}
+
+// Testing trees with a compile-time arity
+TEST_CASE("Testing tree of compile-time arity") {
+    Tree<int, 2> fifteenthTestTree;
+    Tree<int> sixteenthTestTree;
+
+    CHECK(Tree<int, 2>::arity == 2);
+    CHECK(Tree<int>::arity == dynamic_arity);
+    CHECK(fifteenthTestTree.max_children() == 2);
+    CHECK(sixteenthTestTree.max_children() == 2);
+    REQUIRE_THROWS_AS((Tree<int, 3>(2)), runtime_error);
+
+    // Node 3 has only a left child, so the in-order ends with 6, 3
+    fifteenthTestTree.build_from_parents(vector<int>{1, 2, 3, 4, 5, 6}, {-1, 0, 0, 1, 1, 2});
+    sixteenthTestTree.build_from_parents(vector<int>{1, 2, 3, 4, 5, 6}, {-1, 0, 0, 1, 1, 2});
+
+    vector<int> fixedInOrder;
+    for (auto it = fifteenthTestTree.begin_in_order(); it != fifteenthTestTree.end_in_order(); ++it) {
+        fixedInOrder.push_back(it->get_value());
+    }
+    CHECK(fixedInOrder == vector<int>{4, 2, 5, 1, 6, 3});
+
+    vector<int> dynamicInOrder;
+    for (auto it = sixteenthTestTree.begin_in_order(); it != sixteenthTestTree.end_in_order(); ++it) {
+        dynamicInOrder.push_back(it->get_value());
+    }
+    CHECK(dynamicInOrder == fixedInOrder);
+
+    // For a 3-ary tree the in-order iterator goes in pre-order
+    Tree<int, 3> seventeenthTestTree;
+    seventeenthTestTree.build_from_parents(vector<int>{1, 2, 3, 4, 5}, {-1, 0, 0, 0, 1});
+
+    vector<int> inOrder;
+    for (auto it = seventeenthTestTree.begin_in_order(); it != seventeenthTestTree.end_in_order(); ++it) {
+        inOrder.push_back(it->get_value());
+    }
+    CHECK(inOrder == vector<int>{1, 2, 5, 3, 4});
+}
+
+// Testing the frozen snapshot of a tree
+TEST_CASE("Testing frozen tree") {
+    Tree<string> eighteenthTestTree;
+
+    eighteenthTestTree.build_from_parents(vector<string>{"root", "left", "right", "left-left", "left-right", "right-left"}, {-1, 0, 0, 1, 1, 2});
+    FrozenTree<string> frozen = eighteenthTestTree.freeze();
+
+    REQUIRE(frozen.size() == 6);
+
+    // Every order has to match the iterator of the tree
+    auto check_order = [](auto range, auto begin, auto end) {
+        vector<string> frozenValues(range.begin(), range.end());
+        vector<string> treeValues;
+        for (auto it = begin; it != end; ++it) {
+            treeValues.push_back(it->get_value());
+        }
+        CHECK(frozenValues == treeValues);
+    };
+
+    check_order(frozen.pre_order(), eighteenthTestTree.begin_pre_order(), eighteenthTestTree.end_pre_order());
+    check_order(frozen.post_order(), eighteenthTestTree.begin_post_order(), eighteenthTestTree.end_post_order());
+    check_order(frozen.in_order(), eighteenthTestTree.begin_in_order(), eighteenthTestTree.end_in_order());
+    check_order(frozen.bfs_scan(), eighteenthTestTree.begin_bfs_scan(), eighteenthTestTree.end_bfs_scan());
+    check_order(frozen.dfs_scan(), eighteenthTestTree.begin_dfs_scan(), eighteenthTestTree.end_dfs_scan());
+
+    // The structure arrays: "left" is node 1 with the children 2 and 3, and "right" is node 4
+    CHECK(frozen.value(1) == "left");
+    CHECK(frozen.subtree_size(0) == 6);
+    CHECK(frozen.subtree_size(1) == 3);
+    CHECK(frozen.child_count(1) == 2);
+    CHECK(frozen.first_child(1) == 2);
+    CHECK(frozen.next_sibling(2) == 3);
+    CHECK(frozen.next_sibling(3) == FrozenTree<string>::NO_NODE);
+    CHECK(frozen.next_sibling(1) == 4);
+    CHECK(frozen.parent(5) == 4);
+    CHECK(frozen.parent(0) == FrozenTree<string>::NO_NODE);
+
+    // In a 3-ary tree the in-order is the pre-order
+    Tree<Complex, 3> nineteenthTestTree;
+    nineteenthTestTree.build_from_parents(vector<Complex>{Complex(1.0, 1.0), Complex(2.0, 3.0), Complex(3.0, 4.0), Complex(4.0, 5.0), Complex(5.0, 6.0)}, {-1, 0, 0, 0, 1});
+    FrozenTree<Complex> frozenComplex = nineteenthTestTree.freeze();
+
+    vector<Complex> inOrder(frozenComplex.in_order().begin(), frozenComplex.in_order().end());
+    vector<Complex> preOrder(frozenComplex.pre_order().begin(), frozenComplex.pre_order().end());
+    CHECK(inOrder == preOrder);
+
+    vector<Complex> postOrder(frozenComplex.post_order().begin(), frozenComplex.post_order().end());
+    CHECK(postOrder == vector<Complex>{Complex(5.0, 6.0), Complex(2.0, 3.0), Complex(3.0, 4.0), Complex(4.0, 5.0), Complex(1.0, 1.0)});
+
+    CHECK(Tree<int>().freeze().empty());
+}
+
+// Testing that the traversals don't allocate
+TEST_CASE("Testing traversals without heap allocations") {
+    Tree<int> twentiethTestTree;
+
+    // A chain with side leaves is deeper than the inline stack of the iterators
+    vector<int> values;
+    vector<long> parents;
+    for (int i = 0; i < 200; ++i) {
+        values.push_back(i);
+        parents.push_back(i == 0 ? -1 : (i % 2 == 1 ? i - 1 : i - 2));
+    }
+    twentiethTestTree.build_from_parents(values, parents);
+
+    Tree<int> smallTree;
+    smallTree.build_from_parents(vector<int>{1, 2, 3, 4, 5, 6}, {-1, 0, 0, 1, 1, 2});
+
+    // Copying an iterator copies its stack, so the traversal goes on the given iterator itself
+    auto count_nodes = [](auto it, auto end) {
+        size_t count = 0;
+        for (; it != end; ++it) {
+            ++count;
+        }
+        return count;
+    };
+
+    // A small tree fits in the inline stacks (the checks are done after counting, since they can allocate)
+    size_t before = allocationCount;
+    size_t counts[5] = {
+        count_nodes(smallTree.begin_pre_order(), smallTree.end_pre_order()),
+        count_nodes(smallTree.begin_in_order(), smallTree.end_in_order()),
+        count_nodes(smallTree.begin_post_order(), smallTree.end_post_order()),
+        count_nodes(smallTree.begin_bfs_scan(), smallTree.end_bfs_scan()),
+        count_nodes(smallTree.begin_dfs_scan(), smallTree.end_dfs_scan())
+    };
+    size_t allocations = allocationCount - before;
+
+    CHECK(allocations == 0);
+    for (size_t count : counts) {
+        CHECK(count == 6);
+    }
+
+    // A big tree only uses the scratch buffer, which stops growing after the first traversal
+    vector<Node<int> *> scratch;
+    vector<Tree<int>::PostOrderFrame> frameScratch;
+    count_nodes(twentiethTestTree.begin_post_order(frameScratch), twentiethTestTree.end_post_order());
+
+    before = allocationCount;
+    size_t bigCounts[5] = {
+        count_nodes(twentiethTestTree.begin_pre_order(scratch), twentiethTestTree.end_pre_order()),
+        count_nodes(twentiethTestTree.begin_in_order(scratch), twentiethTestTree.end_in_order()),
+        count_nodes(twentiethTestTree.begin_post_order(frameScratch), twentiethTestTree.end_post_order()),
+        count_nodes(twentiethTestTree.begin_bfs_scan(scratch), twentiethTestTree.end_bfs_scan()),
+        count_nodes(twentiethTestTree.begin_dfs_scan(scratch), twentiethTestTree.end_dfs_scan())
+    };
+    allocations = allocationCount - before;
+
+    CHECK(allocations == 0);
+    for (size_t count : bigCounts) {
+        CHECK(count == 200);
+    }
+
+    // Without a scratch buffer the result is the same
+    vector<int> withScratch;
+    vector<int> withoutScratch;
+    for (auto it = twentiethTestTree.begin_post_order(frameScratch); it != twentiethTestTree.end_post_order(); ++it) {
+        withScratch.push_back(it->get_value());
+    }
+    for (auto it = twentiethTestTree.begin_post_order(); it != twentiethTestTree.end_post_order(); ++it) {
+        withoutScratch.push_back(it->get_value());
+    }
+    CHECK(withScratch == withoutScratch);
+}
+
+// Testing the for_each traversals against the iterators
+TEST_CASE("Testing for_each traversals") {
+    // Trees of a few arities with a fixed pseudo random shape
+    for (size_t k : {2, 3, 5}) {
+        Tree<int> twentyFirstTestTree(k);
+
+        vector<int> values;
+        vector<long> parents;
+        vector<size_t> childCounts;
+        unsigned seed = 7;
+        for (int i = 0; i < 300; ++i) {
+            values.push_back(i);
+            childCounts.push_back(0);
+
+            if (i == 0) {
+                parents.push_back(-1);
+                continue;
+            }
+
+            long parent;
+            do {
+                seed = seed * 1103515245 + 12345;
+                parent = (seed >> 8) % i;
+            } while (childCounts[parent] >= k);
+
+            ++childCounts[parent];
+            parents.push_back(parent);
+        }
+        twentyFirstTestTree.build_from_parents(values, parents);
+
+        auto iterator_values = [](auto it, auto end) {
+            vector<int> result;
+            for (; it != end; ++it) {
+                result.push_back(it->get_value());
+            }
+            return result;
+        };
+
+        vector<int> preOrder, postOrder, inOrder, bfs;
+        twentyFirstTestTree.for_each_pre_order([&](Node<int> &node) { preOrder.push_back(node.get_value()); });
+        twentyFirstTestTree.for_each_post_order([&](Node<int> &node) { postOrder.push_back(node.get_value()); });
+        twentyFirstTestTree.for_each_in_order([&](Node<int> &node) { inOrder.push_back(node.get_value()); });
+        twentyFirstTestTree.for_each_bfs([&](Node<int> &node) { bfs.push_back(node.get_value()); });
+
+        CHECK(preOrder == iterator_values(twentyFirstTestTree.begin_pre_order(), twentyFirstTestTree.end_pre_order()));
+        CHECK(postOrder == iterator_values(twentyFirstTestTree.begin_post_order(), twentyFirstTestTree.end_post_order()));
+        CHECK(inOrder == iterator_values(twentyFirstTestTree.begin_in_order(), twentyFirstTestTree.end_in_order()));
+        CHECK(bfs == iterator_values(twentyFirstTestTree.begin_bfs_scan(), twentyFirstTestTree.end_bfs_scan()));
+    }
+
+    // An empty tree visits nothing
+    Tree<int> emptyTree;
+    size_t visited = 0;
+    emptyTree.for_each_post_order([&](Node<int> &) { ++visited; });
+    emptyTree.for_each_in_order([&](Node<int> &) { ++visited; });
+    CHECK(visited == 0);
+}
+
+// Testing the post-order iterator on wide trees
+TEST_CASE("Testing post-order iterator on wide trees") {
+    // A 64-ary tree of 3 full levels and a partial one
+    Tree<int> twentySecondTestTree(64);
+
+    vector<int> values;
+    vector<long> parents;
+    for (int i = 0; i < 5000; ++i) {
+        values.push_back(i);
+        parents.push_back(i == 0 ? -1 : (i - 1) / 64);
+    }
+    twentySecondTestTree.build_from_parents(values, parents);
+
+    // The reference post-order, with the children of node i being 64i+1..64i+64
+    vector<int> expected;
+    function<void(int)> post_order = [&](int node) {
+        for (int child = 64 * node + 1; child <= 64 * node + 64 && child < 5000; ++child) {
+            post_order(child);
+        }
+        expected.push_back(node);
+    };
+    post_order(0);
+
+    vector<int> postOrder;
+    for (auto it = twentySecondTestTree.begin_post_order(); it != twentySecondTestTree.end_post_order(); ++it) {
+        postOrder.push_back(it->get_value());
+    }
+    CHECK(postOrder == expected);
+
+    // The same node twice under one parent is visited twice
+    Tree<string> twentyThirdTestTree(3);
+
+    Node<string> root("root");
+    Node<string> leaf("leaf");
+    Node<string> other("other");
+
+    twentyThirdTestTree.add_root(root);
+    twentyThirdTestTree.add_sub_node_direct(root, leaf);
+    twentyThirdTestTree.add_sub_node_direct(root, other);
+    twentyThirdTestTree.add_sub_node_direct(root, leaf);
+
+    vector<string> repeated;
+    for (auto it = twentyThirdTestTree.begin_post_order(); it != twentyThirdTestTree.end_post_order(); ++it) {
+        repeated.push_back(it->get_value());
+    }
+    CHECK(repeated == vector<string>{"leaf", "other", "leaf", "root"});
+}
+
+// Testing the parallel traversals
+TEST_CASE("Testing parallel traversals") {
+    // A random tree where the value of every node is its index
+    const int nodes = 20000;
+    vector<int> values(nodes);
+    vector<long> parents(nodes);
+    srand(7);
+    for (int i = 0; i < nodes; ++i) {
+        values[i] = i;
+        parents[i] = i == 0 ? -1 : rand() % i;
+    }
+
+    Tree<int> twentyFourthTestTree(nodes);
+    twentyFourthTestTree.build_from_parents(values, parents);
+
+    for (size_t threads : {1, 2, 4}) {
+        // Every node is visited exactly once
+        vector<atomic<int>> visits(nodes);
+        parallel_for_each(twentyFourthTestTree, [&](Node<int> &node) {
+            visits[node.get_value()].fetch_add(1);
+        }, ParallelOrder::unordered, threads);
+
+        bool allOnce = true;
+        for (auto &count : visits) {
+            allOnce = allOnce && count.load() == 1;
+        }
+        CHECK(allOnce);
+
+        // The children are visited before their parent, so the subtree sizes can be summed bottom-up
+        vector<int> subtreeSizes(nodes, 0);
+        atomic<bool> childAfterParent(false);
+        parallel_for_each(twentyFourthTestTree, [&](Node<int> &node) {
+            int size = 1;
+            for (auto child : node.get_children()) {
+                if (subtreeSizes[child->get_value()] == 0) {
+                    childAfterParent = true;
+                }
+                size += subtreeSizes[child->get_value()];
+            }
+            subtreeSizes[node.get_value()] = size;
+        }, ParallelOrder::post_order, threads);
+
+        CHECK_FALSE(childAfterParent);
+        CHECK(subtreeSizes[0] == nodes);
+    }
+
+    // A deep chain, so the stacks of the workers get long
+    Tree<int> twentyFifthTestTree(2);
+    vector<long> chain(nodes);
+    for (int i = 0; i < nodes; ++i) {
+        chain[i] = i - 1;
+    }
+    twentyFifthTestTree.build_from_parents(values, chain);
+
+    vector<int> postOrder;
+    parallel_for_each(twentyFifthTestTree, [&](Node<int> &node) {
+        postOrder.push_back(node.get_value());
+    }, ParallelOrder::post_order, 4);
+
+    CHECK(postOrder.size() == static_cast<size_t>(nodes));
+    CHECK(postOrder.front() == nodes - 1);
+    CHECK(postOrder.back() == 0);
+
+    // An empty tree does nothing, and an exception stops the traversal and is thrown back
+    Tree<int> emptyTree(2);
+    int calls = 0;
+    parallel_for_each(emptyTree, [&](Node<int> &) { ++calls; }, ParallelOrder::post_order, 4);
+    CHECK(calls == 0);
+
+    CHECK_THROWS_AS(parallel_for_each(twentyFourthTestTree, [](Node<int> &node) {
+        if (node.get_value() == nodes / 2) {
+            throw runtime_error("############ Error: Stop... ############");
+        }
+    }, ParallelOrder::unordered, 4), runtime_error);
+}
+
+// Testing the conversion to a min-heap
+TEST_CASE("Testing myHeap") {
+    // Checks that no node is bigger than its children
+    auto is_heap_ordered = [](Tree<int> &tree) {
+        bool ordered = true;
+        tree.for_each_pre_order([&](Node<int> &node) {
+            for (auto child : node.get_children()) {
+                if (child && node.get_value() > child->get_value()) {
+                    ordered = false;
+                }
+            }
+        });
+        return ordered;
+    };
+
+    srand(11);
+    for (size_t k : {2, 3, 8}) {
+        for (size_t threads : {1, 4}) {
+            const int nodes = 3000;
+            vector<int> values(nodes);
+            vector<long> parents(nodes);
+            vector<size_t> childCounts(nodes, 0);
+
+            for (int i = 0; i < nodes; ++i) {
+                values[i] = rand() % 500; // With repeated values
+                parents[i] = -1;
+
+                // A random parent that has room for one more child
+                while (i > 0 && parents[i] == -1) {
+                    long parent = rand() % i;
+                    if (childCounts[parent] < k) {
+                        parents[i] = parent;
+                        ++childCounts[parent];
+                    }
+                }
+            }
+
+            Tree<int> twentySixthTestTree(k);
+            twentySixthTestTree.build_from_parents(values, parents);
+            twentySixthTestTree.myHeap(threads);
+
+            CHECK(is_heap_ordered(twentySixthTestTree));
+            CHECK(twentySixthTestTree.get_root()->get_value() == *min_element(values.begin(), values.end()));
+
+            // The same values, only in other nodes
+            vector<int> heapValues;
+            twentySixthTestTree.for_each_pre_order([&](Node<int> &node) { heapValues.push_back(node.get_value()); });
+            sort(heapValues.begin(), heapValues.end());
+            sort(values.begin(), values.end());
+            CHECK(heapValues == values);
+        }
+    }
+
+    // A chain needs a value to move down many levels, which one swap per level did not do
+    Tree<int> twentySeventhTestTree(2);
+    twentySeventhTestTree.build_from_parents(vector<int>{5, 4, 3, 2, 1}, vector<long>{-1, 0, 1, 2, 3});
+    twentySeventhTestTree.myHeap();
+
+    vector<int> chain;
+    for (auto it = twentySeventhTestTree.begin_pre_order(); it != twentySeventhTestTree.end_pre_order(); ++it) {
+        chain.push_back(it->get_value());
+    }
+    CHECK(chain == vector<int>{1, 2, 3, 4, 5});
+
+    // The index follows the values
+    Tree<string> twentyEighthTestTree(3);
+    twentyEighthTestTree.build_from_parents(vector<string>{"c", "b", "a"}, vector<long>{-1, 0, 0});
+    twentyEighthTestTree.enable_index();
+    twentyEighthTestTree.myHeap();
+
+    CHECK(twentyEighthTestTree.get_root()->get_value() == "a");
+    CHECK(twentyEighthTestTree.find_node("a") == twentyEighthTestTree.get_root());
+}
+
+// Testing the heap iterator
+TEST_CASE("Testing heap iterator") {
+    srand(13);
+    const int nodes = 2000;
+    vector<int> values(nodes);
+    vector<long> parents(nodes);
+    for (int i = 0; i < nodes; ++i) {
+        values[i] = rand() % 1000;
+        parents[i] = i == 0 ? -1 : rand() % i;
+    }
+
+    vector<int> sorted = values;
+    sort(sorted.begin(), sorted.end());
+
+    Tree<int> twentyNinthTestTree(nodes);
+    twentyNinthTestTree.build_from_parents(values, parents);
+    CHECK_FALSE(twentyNinthTestTree.is_heap_ordered());
+
+    // Without the heap order all the nodes are gathered first
+    vector<int> heapOrder;
+    for (auto it = twentyNinthTestTree.begin_heap(); it != twentyNinthTestTree.end_heap(); ++it) {
+        heapOrder.push_back(it->get_value());
+    }
+    CHECK(heapOrder == sorted);
+
+    // With the heap order only the frontier is kept
+    twentyNinthTestTree.myHeap();
+    CHECK(twentyNinthTestTree.is_heap_ordered());
+
+    heapOrder.clear();
+    for (auto it = twentyNinthTestTree.begin_heap(); it != twentyNinthTestTree.end_heap(); ++it) {
+        heapOrder.push_back(it->get_value());
+    }
+    CHECK(heapOrder == sorted);
+
+    // The first few values without going over the whole tree
+    vector<int> firstFive;
+    for (auto it = twentyNinthTestTree.begin_heap(); it != twentyNinthTestTree.end_heap() && firstFive.size() < 5; ++it) {
+        firstFive.push_back(it->get_value());
+    }
+    CHECK(firstFive == vector<int>(sorted.begin(), sorted.begin() + 5));
+
+    // Adding a node breaks the heap order
+    Node<int> &smallest = twentyNinthTestTree.create_node(-1);
+    twentyNinthTestTree.add_sub_node_direct(*twentyNinthTestTree.get_root(), smallest);
+    CHECK_FALSE(twentyNinthTestTree.is_heap_ordered());
+    CHECK(twentyNinthTestTree.begin_heap()->get_value() == -1);
+
+    // An empty tree
+    Tree<int> emptyTree(2);
+    CHECK_FALSE(emptyTree.begin_heap() != emptyTree.end_heap());
+}
+
+// Testing the top-k and k-th value queries
+TEST_CASE("Testing top_k and kth") {
+    srand(17);
+    const int nodes = 5000;
+    vector<int> values(nodes);
+    vector<long> parents(nodes);
+    for (int i = 0; i < nodes; ++i) {
+        values[i] = rand() % 3000;
+        parents[i] = i == 0 ? -1 : rand() % i;
+    }
+
+    Tree<int> thirtiethTestTree(nodes);
+    thirtiethTestTree.build_from_parents(values, parents);
+
+    vector<int> sorted = values;
+    sort(sorted.begin(), sorted.end());
+
+    // Both the bounded heap (small k) and the selection (big k)
+    for (size_t k : {1, 10, 1024, 1025, 4000}) {
+        CHECK(thirtiethTestTree.top_k(k) == vector<int>(sorted.begin(), sorted.begin() + k));
+        CHECK(thirtiethTestTree.top_k(k, [](int a, int b) { return a > b; }) == vector<int>(sorted.rbegin(), sorted.rbegin() + k));
+        CHECK(thirtiethTestTree.kth(k) == sorted[k]);
+    }
+
+    CHECK(thirtiethTestTree.top_k(0).empty());
+    CHECK(thirtiethTestTree.top_k(nodes * 2) == sorted);
+    CHECK_THROWS_AS(thirtiethTestTree.kth(nodes), runtime_error);
+
+    // Complex values, in the order of their operator>
+    Tree<Complex> thirtyFirstTestTree(3);
+    thirtyFirstTestTree.build_from_parents(vector<Complex>{Complex(2, 1), Complex(1, 5), Complex(2, 0), Complex(-1, 3)},
+                                           vector<long>{-1, 0, 0, 1});
+
+    CHECK(thirtyFirstTestTree.top_k(2) == vector<Complex>{Complex(-1, 3), Complex(1, 5)});
+    CHECK(thirtyFirstTestTree.top_k(1, [](const Complex &a, const Complex &b) { return a > b; }) == vector<Complex>{Complex(2, 1)});
+    CHECK(thirtyFirstTestTree.kth(2) == Complex(2, 0));
+}
+
+// Testing the complex array kernels
+TEST_CASE("Testing complex array kernels") {
+    // Random values, with some equal real parts and special values for the comparison
+    srand(19);
+    vector<Complex> first, second;
+    for (int i = 0; i < 1003; ++i) {
+        double real = (rand() % 2000 - 1000) / 7.0;
+        first.push_back(Complex(real, (rand() % 2000 - 1000) / 3.0));
+        second.push_back(Complex(i % 3 == 0 ? real : (rand() % 2000 - 1000) / 7.0, (rand() % 2000 - 1000) / 3.0));
+    }
+    first[5] = Complex(NAN, 1);
+    second[6] = Complex(2, NAN);
+    first[7] = Complex(INFINITY, -INFINITY);
+
+    ComplexArray a(first), b(second);
+    CHECK(a.size() == 1003);
+    CHECK(a[10] == first[10]);
+
+    // The scalar kernels against Complex
+    vector<uint8_t> greater;
+    complex_greater(a, b, greater, ComplexKernel::scalar);
+    bool sameAsComplex = true;
+    for (size_t i = 0; i < first.size(); ++i) {
+        sameAsComplex = sameAsComplex && (greater[i] == 1) == (first[i] > second[i]);
+    }
+    CHECK(sameAsComplex);
+
+    ComplexArray sum, product, scaled;
+    vector<double> magnitudes;
+    complex_add(a, b, sum, ComplexKernel::scalar);
+    complex_multiply(a, b, product, ComplexKernel::scalar);
+    complex_scale(a, Complex(0.5, -2), scaled, ComplexKernel::scalar);
+    complex_magnitude(a, magnitudes, ComplexKernel::scalar);
+
+    CHECK(sum[3] == Complex(first[3].get_real() + second[3].get_real(), first[3].get_imag() + second[3].get_imag()));
+    CHECK(magnitudes[3] == sqrt(first[3].get_real() * first[3].get_real() + first[3].get_imag() * first[3].get_imag()));
+
+    // Every other kernel gives exactly the same bits
+    auto same_bits = [](const double *x, const double *y, size_t count) {
+        return memcmp(x, y, count * sizeof(double)) == 0;
+    };
+
+    for (ComplexKernel kernel : {ComplexKernel::sse2, ComplexKernel::avx2, ComplexKernel::best}) {
+        if (!complex_kernel_supported(kernel)) {
+            CHECK_THROWS_AS(complex_add(a, b, sum, kernel), runtime_error);
+            continue;
+        }
+
+        ComplexArray otherSum, otherProduct, otherScaled;
+        vector<double> otherMagnitudes;
+        vector<uint8_t> otherGreater;
+
+        complex_add(a, b, otherSum, kernel);
+        complex_multiply(a, b, otherProduct, kernel);
+        complex_scale(a, Complex(0.5, -2), otherScaled, kernel);
+        complex_magnitude(a, otherMagnitudes, kernel);
+        complex_greater(a, b, otherGreater, kernel);
+
+        CHECK(same_bits(sum.real_data(), otherSum.real_data(), sum.size()));
+        CHECK(same_bits(sum.imag_data(), otherSum.imag_data(), sum.size()));
+        CHECK(same_bits(product.real_data(), otherProduct.real_data(), product.size()));
+        CHECK(same_bits(product.imag_data(), otherProduct.imag_data(), product.size()));
+        CHECK(same_bits(scaled.real_data(), otherScaled.real_data(), scaled.size()));
+        CHECK(same_bits(scaled.imag_data(), otherScaled.imag_data(), scaled.size()));
+        CHECK(same_bits(magnitudes.data(), otherMagnitudes.data(), magnitudes.size()));
+        CHECK(greater == otherGreater);
+    }
+
+    // In place, and different sizes
+    complex_add(a, a, a);
+    CHECK(a[10] == Complex(first[10].get_real() * 2, first[10].get_imag() * 2));
+
+    ComplexArray shorter(10);
+    CHECK_THROWS_AS(complex_add(a, shorter, sum), runtime_error);
+}
+
+// Testing complex arithmetic
+TEST_CASE("Testing complex arithmetic") {
+    // Everything but abs works at compile time
+    constexpr Complex first(1, 2);
+    constexpr Complex second(3, -4);
+    static_assert(first + second == Complex(4, -2), "constexpr addition");
+    static_assert(first - second == Complex(-2, 6), "constexpr subtraction");
+    static_assert(first * second == Complex(11, 2), "constexpr multiplication");
+    static_assert((first * second) / second == first, "constexpr division");
+    static_assert(second.norm() == 25, "constexpr norm");
+    static_assert(first.conj() == Complex(1, -2), "constexpr conjugate");
+    static_assert(first < second && second > first && !(first < first) && first <= first, "constexpr comparison");
+    static_assert(noexcept(first * second) && noexcept(first / second), "noexcept arithmetic");
+
+    CHECK(second.abs() == 5);
+    CHECK(-first == Complex(-1, -2));
+    CHECK(Complex() == Complex(0, 0));
+
+    Complex value(1, 1);
+    value += Complex(1, 0);
+    value *= Complex(0, 1);
+    value -= Complex(0, 2);
+    CHECK(value == Complex(-1, 0));
+    value /= Complex(0, 1);
+    CHECK(value == Complex(0, 1));
+
+    CHECK(hash<Complex>()(first) == hash<Complex>()(Complex(1, 2)));
+
+    // The same bits as the array kernels
+    vector<Complex> left, right;
+    for (int i = 0; i < 100; ++i) {
+        left.push_back(Complex(i / 7.0, -i / 3.0));
+        right.push_back(Complex(1 / (i + 1.0), i * 0.1));
+    }
+
+    ComplexArray product;
+    vector<double> magnitudes;
+    complex_multiply(ComplexArray(left), ComplexArray(right), product);
+    complex_magnitude(ComplexArray(left), magnitudes);
+
+    bool sameBits = true;
+    for (size_t i = 0; i < left.size(); ++i) {
+        Complex expected = left[i] * right[i];
+        Complex actual = product[i];
+        double magnitude = left[i].abs();
+        sameBits = sameBits && memcmp(&expected, &actual, sizeof(Complex)) == 0 &&
+                   memcmp(&magnitude, &magnitudes[i], sizeof(double)) == 0;
+    }
+    CHECK(sameBits);
+
+    // The heap and sort code can use the operators directly
+    vector<Complex> sorted = left;
+    sort(sorted.begin(), sorted.end());
+    CHECK(is_sorted(sorted.begin(), sorted.end(), [](const Complex &a, const Complex &b) { return b > a; }));
+}
+
+// Testing heaps and queries with other orders
+TEST_CASE("Testing comparators") {
+    srand(23);
+    const int nodes = 1000;
+    vector<int> values(nodes);
+    vector<long> parents(nodes);
+    for (int i = 0; i < nodes; ++i) {
+        values[i] = rand() % 5000;
+        parents[i] = i == 0 ? -1 : rand() % i;
+    }
+
+    vector<int> biggestFirst = values;
+    sort(biggestFirst.rbegin(), biggestFirst.rend());
+
+    // A max-heap
+    Tree<int> thirtySecondTestTree(nodes);
+    thirtySecondTestTree.build_from_parents(values, parents);
+    thirtySecondTestTree.myHeap(2, BiggerFirst());
+
+    CHECK(thirtySecondTestTree.is_heap_ordered(BiggerFirst()));
+    CHECK_FALSE(thirtySecondTestTree.is_heap_ordered());
+    CHECK(thirtySecondTestTree.get_root()->get_value() == biggestFirst[0]);
+
+    vector<int> heapOrder;
+    for (auto it = thirtySecondTestTree.begin_heap(BiggerFirst()); it != thirtySecondTestTree.end_heap(); ++it) {
+        heapOrder.push_back(it->get_value());
+    }
+    CHECK(heapOrder == biggestFirst);
+
+    // The default order on the same tree is not lazy, but still right
+    CHECK(thirtySecondTestTree.begin_heap()->get_value() == biggestFirst.back());
+    CHECK(thirtySecondTestTree.top_k(3, BiggerFirst()) == vector<int>(biggestFirst.begin(), biggestFirst.begin() + 3));
+
+    // Complex values by magnitude, with the key projection
+    Tree<Complex> thirtyThirdTestTree(3);
+    thirtyThirdTestTree.build_from_parents(vector<Complex>{Complex(3, 4), Complex(1, 0), Complex(0, -2), Complex(-6, 8), Complex(0, 0)},
+                                           vector<long>{-1, 0, 0, 1, 2});
+
+    auto byMagnitude = by_key([](const Complex &z) { return z.norm(); });
+    thirtyThirdTestTree.myHeap(1, byMagnitude);
+    CHECK(thirtyThirdTestTree.is_heap_ordered(byMagnitude));
+
+    vector<Complex> byNorm;
+    for (auto it = thirtyThirdTestTree.begin_heap(byMagnitude); it != thirtyThirdTestTree.end_heap(); ++it) {
+        byNorm.push_back(it->get_value());
+    }
+    CHECK(byNorm == vector<Complex>{Complex(0, 0), Complex(1, 0), Complex(0, -2), Complex(3, 4), Complex(-6, 8)});
+
+    // Biggest magnitude first
+    CHECK(thirtyThirdTestTree.top_k(1, by_key([](const Complex &z) { return z.norm(); }, BiggerFirst())) == vector<Complex>{Complex(-6, 8)});
+
+    // Two function pointers have the same type but are different orders, so the tree is not taken as heap-ordered by the other one
+    bool (*smaller)(int, int) = [](int a, int b) { return a < b; };
+    bool (*bigger)(int, int) = [](int a, int b) { return a > b; };
+
+    Tree<int> fiftyFifthTestTree(3);
+    fiftyFifthTestTree.build_from_parents(vector<int>{5, 9, 1, 7, 3, 8, 2}, vector<long>{-1, 0, 0, 0, 1, 1, 2});
+    fiftyFifthTestTree.myHeap(1, bigger);
+    CHECK(fiftyFifthTestTree.get_root()->get_value() == 9);
+    CHECK_FALSE(fiftyFifthTestTree.is_heap_ordered(smaller));
+    CHECK_FALSE(fiftyFifthTestTree.is_heap_ordered(bigger));
+
+    vector<int> ascending;
+    for (auto it = fiftyFifthTestTree.begin_heap(smaller); it != fiftyFifthTestTree.end_heap(); ++it) {
+        ascending.push_back(it->get_value());
+    }
+    CHECK(ascending == vector<int>{1, 2, 3, 5, 7, 8, 9});
+}
+
+// Testing saving and loading trees
+TEST_CASE("Testing tree files") {
+    const string path = "test_tree.bin";
+
+    // Ints, with a read-only mapped tree and a rebuilt one
+    srand(29);
+    const int nodes = 3000;
+    vector<int> values(nodes);
+    vector<long> parents(nodes);
+    for (int i = 0; i < nodes; ++i) {
+        values[i] = rand() - RAND_MAX / 2;
+        parents[i] = i == 0 ? -1 : rand() % i;
+    }
+
+    Tree<int> thirtyFourthTestTree(nodes);
+    thirtyFourthTestTree.build_from_parents(values, parents);
+    thirtyFourthTestTree.save(path);
+
+    FrozenTree<int> frozen = thirtyFourthTestTree.freeze();
+    MappedTree<int> mapped = Tree<int>::load_mmap(path);
+    CHECK(mapped.size() == static_cast<size_t>(nodes));
+    CHECK(mapped.arity() == static_cast<size_t>(nodes));
+
+    bool sameTree = true;
+    for (uint32_t i = 0; i < frozen.size(); ++i) {
+        sameTree = sameTree && mapped.value(i) == frozen.value(i) && mapped.parent(i) == frozen.parent(i) &&
+                   mapped.subtree_size(i) == frozen.subtree_size(i) && mapped.child_count(i) == frozen.child_count(i) &&
+                   mapped.next_sibling(i) == frozen.next_sibling(i);
+    }
+    CHECK(sameTree);
+    CHECK(vector<int>(mapped.pre_order().begin(), mapped.pre_order().end()) ==
+          vector<int>(frozen.pre_order().begin(), frozen.pre_order().end()));
+
+    Tree<int> thirtyFifthTestTree(nodes);
+    thirtyFifthTestTree.load(path);
+    vector<int> loaded, original;
+    thirtyFifthTestTree.for_each_post_order([&](Node<int> &node) { loaded.push_back(node.get_value()); });
+    thirtyFourthTestTree.for_each_post_order([&](Node<int> &node) { original.push_back(node.get_value()); });
+    CHECK(loaded == original);
+
+    // Loading again frees the nodes of the last load
+    thirtyFifthTestTree.load(path);
+    CHECK(thirtyFifthTestTree.owned_nodes() == static_cast<size_t>(nodes));
+
+    // The node indexes are checked
+    CHECK_THROWS_AS(mapped.value(nodes), runtime_error);
+    CHECK_THROWS_AS(mapped.next_sibling(nodes), runtime_error);
+
+    // A smaller arity can't hold it, and other value types can't read it
+    Tree<int> smallTree(2);
+    CHECK_THROWS_AS(smallTree.load(path), runtime_error);
+    CHECK_THROWS_AS(Tree<double>::load_mmap(path), runtime_error);
+    CHECK_THROWS_AS(Tree<string>::load_mmap(path), runtime_error);
+
+    // Strings and Complex values
+    Tree<string> thirtySixthTestTree(3);
+    thirtySixthTestTree.build_from_parents(vector<string>{"root", "", "a longer string value", "x"}, vector<long>{-1, 0, 0, 1});
+    thirtySixthTestTree.save(path);
+
+    MappedTree<string> mappedStrings = Tree<string>::load_mmap(path);
+    CHECK(mappedStrings.value(0) == "root");
+    CHECK(mappedStrings.value(1) == "");
+    CHECK(mappedStrings.value(2) == "x");
+    CHECK(mappedStrings.value(3) == "a longer string value");
+
+    Tree<Complex> thirtySeventhTestTree(2);
+    thirtySeventhTestTree.build_from_parents(vector<Complex>{Complex(1, 2), Complex(3, 4), Complex(5, 6)}, vector<long>{-1, 0, 0});
+    thirtySeventhTestTree.save(path);
+
+    Tree<Complex> thirtyEighthTestTree(2);
+    thirtyEighthTestTree.load(path);
+    vector<Complex> inOrder;
+    for (auto it = thirtyEighthTestTree.begin_in_order(); it != thirtyEighthTestTree.end_in_order(); ++it) {
+        inOrder.push_back(it->get_value());
+    }
+    CHECK(inOrder == vector<Complex>{Complex(3, 4), Complex(1, 2), Complex(5, 6)});
+
+    // An empty tree
+    Tree<int> emptyTree(2);
+    emptyTree.save(path);
+    CHECK(Tree<int>::load_mmap(path).empty());
+
+    // Damaged and missing files
+    {
+        ofstream out(path, ios::binary | ios::trunc);
+        out << "not a tree file, but long enough to hold a whole header of the tree file format";
+    }
+    CHECK_THROWS_AS(Tree<int>::load_mmap(path), runtime_error);
+
+    thirtyFourthTestTree.save(path);
+    truncate(path.c_str(), 1000);
+    CHECK_THROWS_AS(Tree<int>::load_mmap(path), runtime_error);
+
+    // Damaged sections in a file of the right size: a value is written over an item of a section
+    auto damage = [&](uint64_t TreeFileHeader::*section, uint64_t item, auto value) {
+        TreeFileHeader header;
+        fstream file(path, ios::in | ios::out | ios::binary);
+        file.read(reinterpret_cast<char *>(&header), sizeof(header));
+        file.seekp(static_cast<streamoff>(header.*section + item * sizeof(value)));
+        file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    };
+
+    // Only verify() (or load) finds them, the accessors still never read out of the file
+    thirtyFourthTestTree.save(path);
+    damage(&TreeFileHeader::parentsOffset, 5, uint32_t(1000000));
+    CHECK_THROWS_AS(Tree<int>::load_mmap(path, true), runtime_error);
+    CHECK_THROWS_AS(thirtyFifthTestTree.load(path), runtime_error);
+    CHECK(thirtyFifthTestTree.owned_nodes() == static_cast<size_t>(nodes)); // A failed load does not change the tree
+    CHECK_THROWS_AS(Tree<int>::load_mmap(path).next_sibling(5), runtime_error);
+
+    thirtyFourthTestTree.save(path);
+    damage(&TreeFileHeader::subtreeSizesOffset, 3, uint32_t(4000000000u));
+    CHECK_THROWS_AS(Tree<int>::load_mmap(path, true), runtime_error);
+
+    thirtyFourthTestTree.save(path);
+    damage(&TreeFileHeader::childCountsOffset, 0, uint32_t(nodes));
+    {
+        MappedTree<int> unverified = Tree<int>::load_mmap(path);
+        CHECK(unverified.child_count(0) == static_cast<uint32_t>(nodes));
+        CHECK_THROWS_AS(unverified.verify(), runtime_error);
+    }
+
+    thirtySixthTestTree.save(path);
+    damage(&TreeFileHeader::valuesOffset, 2, uint64_t(1000));
+    CHECK_THROWS_AS(Tree<string>::load_mmap(path, true), runtime_error);
+    CHECK_THROWS_AS(Tree<string>::load_mmap(path).value(1), runtime_error);
+
+    thirtySixthTestTree.save(path);
+    CHECK(Tree<string>::load_mmap(path).size() == 4);
+
+    remove(path.c_str());
+    CHECK_THROWS_AS(Tree<int>::load_mmap(path), runtime_error);
+}
+
+// Testing the CSV tree loader
+TEST_CASE("Testing CSV tree loader") {
+    // With a header, Windows line ends, a child before its parent and no newline at the end
+    istringstream ints("parent_id,child_id,value\r\n,10,1\r\n10,20,2\r\n30,40,4\n10,30,3\n20,50,5");
+    Tree<int> thirtyNinthTestTree(3);
+    load_tree_csv(thirtyNinthTestTree, ints, 8); // Tiny chunks, so lines are split between chunks
+
+    vector<int> preOrder;
+    thirtyNinthTestTree.for_each_pre_order([&](Node<int> &node) { preOrder.push_back(node.get_value()); });
+    CHECK(preOrder == vector<int>{1, 2, 5, 3, 4});
+
+    // Doubles, strings (the rest of the line) and Complex (two columns)
+    istringstream doubles("-1,0,1.5\n0,1,-2.25e3\n");
+    Tree<double> fortiethTestTree(2);
+    load_tree_csv(fortiethTestTree, doubles);
+    CHECK(fortiethTestTree.get_root()->get_children()[0]->get_value() == -2250.0);
+
+    istringstream strings(",1,root node\n1,2,a, b and c\n");
+    Tree<string> fortyFirstTestTree(2);
+    load_tree_csv(fortyFirstTestTree, strings);
+    CHECK(fortyFirstTestTree.get_root()->get_children()[0]->get_value() == "a, b and c");
+
+    istringstream complexes(",1,1.5,-2\n1,2,0,1\n");
+    Tree<Complex> fortySecondTestTree(2);
+    load_tree_csv(fortySecondTestTree, complexes);
+    CHECK(fortySecondTestTree.get_root()->get_value() == Complex(1.5, -2));
+    CHECK(fortySecondTestTree.get_root()->get_children()[0]->get_value() == Complex(0, 1));
+
+    // A bigger tree, the same as build_from_parents
+    srand(31);
+    ostringstream text;
+    vector<int> values;
+    vector<long> parents;
+    for (int i = 0; i < 5000; ++i) {
+        values.push_back(rand());
+        parents.push_back(i == 0 ? -1 : rand() % i);
+        text << (i == 0 ? string() : to_string(parents.back())) << ',' << i << ',' << values.back() << '\n';
+    }
+
+    Tree<int> fortyThirdTestTree(5000), fortyFourthTestTree(5000);
+    istringstream bigText(text.str());
+    load_tree_csv(fortyThirdTestTree, bigText, 100);
+    fortyFourthTestTree.build_from_parents(values, parents);
+
+    vector<int> loaded, built;
+    fortyThirdTestTree.for_each_post_order([&](Node<int> &node) { loaded.push_back(node.get_value()); });
+    fortyFourthTestTree.for_each_post_order([&](Node<int> &node) { built.push_back(node.get_value()); });
+    CHECK(loaded == built);
+
+    // Bad input
+    auto load_text = [](const string &csv, size_t maxChildren) {
+        istringstream in(csv);
+        Tree<int> tree(maxChildren);
+        load_tree_csv(tree, in);
+    };
+
+    CHECK_THROWS_AS(load_text(",1,1\n1,2,2\n1,3,3\n", 1), runtime_error);   // Too many children
+    CHECK_THROWS_AS(load_text(",1,1\n,2,2\n", 2), runtime_error);           // Two roots
+    CHECK_THROWS_AS(load_text("1,2,2\n", 2), runtime_error);                // No root
+    CHECK_THROWS_AS(load_text(",1,1\n7,2,2\n", 2), runtime_error);          // A missing parent
+    CHECK_THROWS_AS(load_text(",1,1\n1,1,2\n", 2), runtime_error);          // A repeated id
+    CHECK_THROWS_AS(load_text(",1,1\n1,2,x\n", 2), runtime_error);          // A bad value
+    CHECK_THROWS_AS(load_text(",1,1\n3,2,2\n2,3,3\n", 2), runtime_error);   // A cycle
+    CHECK_THROWS_AS(load_text(",1,1\n1,2\n", 2), runtime_error);            // A missing field
+
+    // An id that was sparse when it came is still found after the dense ids grow past it
+    string sparseText = ",5000,0\n";
+    for (int i = 1; i <= 4500; ++i) {
+        sparseText += "5000," + to_string(i) + "," + to_string(i) + "\n";
+    }
+
+    Tree<int> fiftySixthTestTree(4501);
+    istringstream sparse(sparseText + "5000,9999999,7\n");
+    load_tree_csv(fiftySixthTestTree, sparse);
+    CHECK(fiftySixthTestTree.get_root()->get_value() == 0);
+    CHECK(fiftySixthTestTree.get_root()->get_children().size() == 4501);
+    CHECK(fiftySixthTestTree.get_root()->get_children().back()->get_value() == 7);
+
+    CHECK_THROWS_AS(load_text(sparseText + "4500,5000,1\n", 4501), runtime_error); // A repeated sparse id
+
+    // A failed load frees the nodes it made and leaves the tree as it was
+    size_t owned = fiftySixthTestTree.owned_nodes();
+    istringstream broken(sparseText + "1,2,x\n");
+    CHECK_THROWS_AS(load_tree_csv(fiftySixthTestTree, broken), runtime_error);
+    CHECK(fiftySixthTestTree.owned_nodes() == owned);
+    CHECK(fiftySixthTestTree.get_root()->get_children().size() == 4501);
+}
+
+// Everything that was written to a temporary file
+string read_all(FILE *file) {
+    string text;
+    char chunk[4096];
+    rewind(file);
+    for (size_t count; (count = fread(chunk, 1, sizeof(chunk), file)) > 0;) {
+        text.append(chunk, count);
+    }
+    return text;
+}
+
+TEST_CASE("Testing traversal writer") {
+    Tree<double> fortyFifthTestTree(2);
+    fortyFifthTestTree.build_from_parents(vector<double>{1.1, 1.2, 1.3, 1.4}, vector<long>{-1, 0, 0, 1});
+
+    // Text, like the printed traversals
+    const string printed = "############ Pre-order traversal: ############\n1.1, 1.2, 1.4, 1.3\n\n"
+                           "############ BFS traversal: ############\n1.1, 1.2, 1.3, 1.4\n\n";
+    FILE *textFile = tmpfile();
+    {
+        TraversalWriter writer(fileno(textFile));
+        writer.write_traversal("Pre-order traversal:", fortyFifthTestTree.begin_pre_order(), fortyFifthTestTree.end_pre_order());
+        writer.write_traversal("BFS traversal:", fortyFifthTestTree.begin_bfs_scan(), fortyFifthTestTree.end_bfs_scan());
+        writer.flush();
+        CHECK(writer.bytes_written() == printed.size());
+    }
+    CHECK(read_all(textFile) == printed);
+    fclose(textFile);
+
+    // Numbers are printed with the precision of cout
+    ostringstream coutText;
+    coutText << "############ numbers ############\n" << 1.0 / 3 << ", " << 1e20 << ", " << -2.5e-7 << ", " << 123456789.0 << ", "
+             << Complex(2.0 / 3, -1e-9) << ", " << 42 << "\n\n";
+    FILE *numbersFile = tmpfile();
+    {
+        TraversalWriter writer(fileno(numbersFile));
+        writer.begin_traversal("numbers");
+        writer.write_value(1.0 / 3);
+        writer.write_value(1e20);
+        writer.write_value(-2.5e-7);
+        writer.write_value(123456789.0);
+        writer.write_value(Complex(2.0 / 3, -1e-9));
+        writer.write_value(42);
+        writer.end_traversal();
+    }
+    CHECK(read_all(numbersFile) == coutText.str());
+    fclose(numbersFile);
+
+    // JSON lines, with Complex values and escaped strings
+    FILE *jsonFile = tmpfile();
+    {
+        TraversalWriter writer(fileno(jsonFile), TraversalFormat::json_lines);
+        writer.begin_traversal("pre");
+        writer.write_value(Complex(1.5, -2));
+        writer.write_value(string("say \"hi\"\n"));
+        writer.write_value(INFINITY);
+        writer.end_traversal();
+    }
+    CHECK(read_all(jsonFile) == "{\"traversal\":\"pre\",\"index\":0,\"value\":{\"real\":1.5,\"imag\":-2}}\n"
+                                "{\"traversal\":\"pre\",\"index\":1,\"value\":\"say \\\"hi\\\"\\u000a\"}\n"
+                                "{\"traversal\":\"pre\",\"index\":2,\"value\":null}\n");
+    fclose(jsonFile);
+
+    // Binary, with a small buffer so the values are split into several runs and chunks
+    Tree<int> fortySixthTestTree(3);
+    vector<int> values(1000);
+    vector<long> parents(1000);
+    for (int i = 0; i < 1000; ++i) {
+        values[i] = i * 3;
+        parents[i] = (i - 1) / 3;
+    }
+    parents[0] = -1;
+    fortySixthTestTree.build_from_parents(values, parents);
+
+    FILE *binaryFile = tmpfile();
+    {
+        TraversalWriter writer(fileno(binaryFile), TraversalFormat::binary, 64);
+        writer.write_traversal("bfs", fortySixthTestTree.begin_bfs_scan(), fortySixthTestTree.end_bfs_scan());
+        writer.begin_traversal("strings");
+        writer.write_value(string(200, 'x')); // Bigger than the buffer
+        writer.write_value(string("y"));
+        writer.end_traversal();
+    }
+    string binary = read_all(binaryFile);
+    fclose(binaryFile);
+
+    size_t at = 0;
+    auto read_u32 = [&] {
+        uint32_t number;
+        memcpy(&number, binary.data() + at, sizeof(number));
+        at += sizeof(number);
+        return number;
+    };
+
+    REQUIRE(read_u32() == 3);
+    CHECK(binary.substr(at, 3) == "bfs");
+    at += 3;
+    vector<int> bfs;
+    size_t runs = 0;
+    for (uint32_t run; (run = read_u32()) != 0; ++runs) {
+        for (uint32_t i = 0; i < run; ++i) {
+            int value;
+            memcpy(&value, binary.data() + at, sizeof(value));
+            at += sizeof(value);
+            bfs.push_back(value);
+        }
+    }
+    CHECK(bfs == values);
+    CHECK(runs > 1);
+
+    REQUIRE(read_u32() == 7);
+    at += 7;
+    vector<string> strings;
+    for (uint32_t run; (run = read_u32()) != 0;) {
+        for (uint32_t i = 0; i < run; ++i) {
+            uint32_t size = read_u32();
+            strings.push_back(binary.substr(at, size));
+            at += size;
+        }
+    }
+    CHECK(strings == vector<string>{string(200, 'x'), "y"});
+    CHECK(at == binary.size());
+
+    // A flush in the middle of a traversal ends the run and leaves nothing buffered,
+    // and a traversal that is never ended leaves no empty run that would look like its end
+    FILE *flushedFile = tmpfile();
+    size_t flushedBytes = 0;
+    {
+        TraversalWriter writer(fileno(flushedFile), TraversalFormat::binary);
+        writer.begin_traversal("t");
+        writer.write_value(1);
+        writer.write_value(2);
+        writer.flush();
+        flushedBytes = writer.bytes_written();
+        CHECK(flushedBytes == 4 + 1 + 4 + 2 * sizeof(int));
+        CHECK(writer.bytes_buffered() == 0);
+        writer.flush();
+        CHECK(writer.bytes_written() == flushedBytes);
+    }
+    string flushed = read_all(flushedFile);
+    fclose(flushedFile);
+    CHECK(flushed.size() == flushedBytes);
+
+    // Values after a flush go in a new run
+    FILE *twoRunsFile = tmpfile();
+    {
+        TraversalWriter writer(fileno(twoRunsFile), TraversalFormat::binary);
+        writer.begin_traversal("t");
+        writer.write_value(1);
+        writer.flush();
+        writer.write_value(2);
+        writer.write_value(3);
+        writer.end_traversal();
+    }
+    binary = read_all(twoRunsFile);
+    fclose(twoRunsFile);
+    at = 0;
+    REQUIRE(read_u32() == 1);
+    at += 1;
+    vector<uint32_t> runLengths;
+    vector<int> twoRuns;
+    for (uint32_t run; (run = read_u32()) != 0;) {
+        runLengths.push_back(run);
+        for (uint32_t i = 0; i < run; ++i) {
+            int value;
+            memcpy(&value, binary.data() + at, sizeof(value));
+            at += sizeof(value);
+            twoRuns.push_back(value);
+        }
+    }
+    CHECK(runLengths == vector<uint32_t>{1, 2});
+    CHECK(twoRuns == vector<int>{1, 2, 3});
+    CHECK(at == binary.size());
+
+    // A closed file descriptor
+    int closed = dup(1);
+    close(closed);
+    TraversalWriter broken(closed);
+    broken.write_value(1);
+    CHECK_THROWS_AS(broken.flush(), runtime_error);
+}
+
+// The number of times a piece of text appears
+size_t count_of(const string &text, const string &piece) {
+    size_t count = 0;
+    for (size_t at = text.find(piece); at != string::npos; at = text.find(piece, at + 1)) {
+        ++count;
+    }
+    return count;
+}
+
+TEST_CASE("Testing tree snapshots") {
+    Tree<string> fortySeventhTestTree(3);
+    fortySeventhTestTree.build_from_parents(vector<string>{"root", "a<b", "c&d", "e"}, vector<long>{-1, 0, 0, 1});
+
+    // The layout numbers the nodes in pre-order
+    TreeLayout<Node<string>> layout;
+    layout.compute(fortySeventhTestTree.get_root());
+    REQUIRE(layout.size() == 4);
+    CHECK(layout.node(0)->get_value() == "root");
+    CHECK(layout.node(2)->get_value() == "e");
+    CHECK(layout.parent(0) == layout.NO_NODE);
+    CHECK(layout.parent(2) == 1);
+    CHECK(layout.parent(3) == 0);
+    CHECK(layout.y(2) > layout.y(1));
+    CHECK(layout.x(1) < layout.x(3));
+
+    TreeSnapshotWriter snapshots;
+    string svg = snapshots.render(fortySeventhTestTree);
+    CHECK(count_of(svg, "<circle") == 4);
+    CHECK(count_of(svg, "<line") == 3);
+    CHECK(count_of(svg, "<text") == 4);
+    CHECK(svg.find(">a&lt;b</text>") != string::npos);
+    CHECK(svg.find(">c&amp;d</text>") != string::npos);
+    CHECK(snapshots.last_timing().bytes == svg.size());
+
+    // Labels are the same as in the window
+    CHECK(node_label(Complex(2, 3)) == "2 + 3i");
+    CHECK(node_label(1.5) == "1.500000");
+
+    // Saved to a file, and timed
+    const string path = "test_snapshot.svg";
+    SnapshotTiming timing = snapshots.save(fortySeventhTestTree, path);
+    ifstream in(path, ios::binary);
+    CHECK(string(istreambuf_iterator<char>(in), istreambuf_iterator<char>()) == svg);
+    remove(path.c_str());
+
+    CHECK(timing.bytes == svg.size());
+    CHECK(timing.total_ms() >= 0.0);
+    CHECK(snapshots.frame_count() == 2);
+    CHECK(snapshots.slowest_ms() <= snapshots.total_ms());
+
+    // An empty tree is an empty picture
+    Tree<int> fortyEighthTestTree;
+    CHECK(count_of(snapshots.render(fortyEighthTestTree), "<circle") == 0);
+
+    CHECK_THROWS_AS(snapshots.save(fortySeventhTestTree, "no/such/directory/snapshot.svg"), runtime_error);
+}
+
+// The smallest distance between two nodes of the same level of a layout
+template <typename NodeType>
+float closest_neighbours(const TreeLayout<NodeType> &layout) {
+    vector<pair<float, float>> points;
+    for (size_t i = 0; i < layout.size(); ++i) {
+        points.push_back({layout.y(i), layout.x(i)});
+    }
+    sort(points.begin(), points.end());
+
+    float closest = INFINITY;
+    for (size_t i = 1; i < points.size(); ++i) {
+        if (points[i].first == points[i - 1].first) {
+            closest = min(closest, points[i].second - points[i - 1].second);
+        }
+    }
+    return closest;
+}
+
+TEST_CASE("Testing tree layout") {
+    // A full binary tree 10 levels deep - the old layout put the last levels on top of each other
+    vector<int> values(1023);
+    vector<long> parents(1023);
+    for (int i = 0; i < 1023; ++i) {
+        values[i] = i;
+        parents[i] = (i - 1) / 2;
+    }
+    parents[0] = -1;
+
+    Tree<int> fortyNinthTestTree(2);
+    fortyNinthTestTree.build_from_parents(values, parents);
+
+    TreeLayout<Node<int>> layout(100.f, 60.f);
+    layout.compute(fortyNinthTestTree.get_root());
+    REQUIRE(layout.size() == 1023);
+    CHECK(layout.x(0) == 0.f);
+    CHECK(layout.y(0) == 0.f);
+    CHECK(closest_neighbours(layout) >= 60.f - 0.01f);
+
+    // Parents are centered over their children
+    for (size_t i = 0; i < layout.size(); ++i) {
+        auto children = layout.node(i)->get_children();
+        if (!children.empty()) {
+            uint32_t first = layout.number_of(children.front()), last = layout.number_of(children.back());
+            CHECK(layout.x(i) == doctest::Approx((layout.x(first) + layout.x(last)) / 2));
+            CHECK(layout.y(first) == layout.y(i) + 100.f);
+        }
+    }
+
+    // A long chain is laid out with no recursion
+    Tree<int> fiftiethTestTree(1);
+    vector<int> chainValues(100000, 0);
+    vector<long> chainParents(100000);
+    for (long i = 0; i < 100000; ++i) {
+        chainParents[i] = i - 1;
+    }
+    fiftiethTestTree.build_from_parents(chainValues, chainParents);
+    TreeLayout<Node<int>> chain;
+    chain.compute(fiftiethTestTree.get_root());
+    CHECK(chain.x(99999) == 0.f);
+    CHECK(chain.y(99999) == 99999 * 200.f);
+
+    // Adding nodes one by one gives the same positions as laying out the whole tree
+    srand(17);
+    Tree<int> fiftyFirstTestTree(400);
+    vector<Node<int> *> nodes{&fiftyFirstTestTree.create_node(0)};
+    fiftyFirstTestTree.add_root(*nodes[0]);
+
+    TreeLayout<Node<int>> growing;
+    growing.compute(nodes[0]);
+    for (int i = 1; i < 400; ++i) {
+        Node<int> *parent = nodes[rand() % 3 == 0 ? i - 1 : rand() % i];
+        nodes.push_back(&fiftyFirstTestTree.create_node(i));
+        fiftyFirstTestTree.add_sub_node(*parent, *nodes.back());
+        CHECK(growing.add_node(parent, nodes.back()) == static_cast<uint32_t>(i));
+    }
+
+    TreeLayout<Node<int>> whole;
+    whole.compute(fiftyFirstTestTree.get_root());
+    float worst = 0.f;
+    for (Node<int> *node : nodes) {
+        uint32_t a = growing.number_of(node), b = whole.number_of(node);
+        worst = max(worst, fabs(growing.x(a) - whole.x(b)) + fabs(growing.y(a) - whole.y(b)));
+    }
+    CHECK(worst < 0.01f);
+    CHECK(closest_neighbours(growing) >= 125.f - 0.01f);
+
+    // An insert only moves the children of the new node's ancestors, the subtrees under them keep their offsets
+    vector<double> before(growing.size());
+    for (size_t i = 0; i < growing.size(); ++i) {
+        before[i] = growing.offset(i);
+    }
+    Node<int> *deep = nodes[399];
+    Node<int> &sprout = fiftyFirstTestTree.create_node(999);
+    fiftyFirstTestTree.add_sub_node(*deep, sprout);
+    growing.add_node(deep, &sprout);
+
+    vector<bool> onPath(growing.size(), false);
+    for (uint32_t v = growing.number_of(deep); v != growing.NO_NODE; v = growing.parent(v)) {
+        onPath[v] = true;
+    }
+    for (size_t i = 1; i < before.size(); ++i) {
+        if (!onPath[growing.parent(i)]) {
+            CHECK(growing.offset(i) == before[i]);
+        }
+    }
+
+    // A whole subtree can be added at once
+    Node<int> &branch = fiftyFirstTestTree.create_node(1000);
+    Node<int> &leaf = fiftyFirstTestTree.create_node(1001);
+    fiftyFirstTestTree.add_sub_node(*nodes[5], branch);
+    fiftyFirstTestTree.add_sub_node(branch, leaf);
+    growing.add_node(nodes[5], &branch);
+    CHECK(growing.size() == 403);
+    CHECK(growing.parent(growing.number_of(&leaf)) == growing.number_of(&branch));
+
+    Node<int> &stranger = fiftyFirstTestTree.create_node(-1);
+    CHECK_THROWS_AS(growing.add_node(&stranger, &stranger), runtime_error);
+    CHECK(growing.number_of(&stranger) == growing.NO_NODE);
+}
+
+TEST_CASE("Testing tree version") {
+    Tree<int> fiftySecondTestTree(2);
+    uint64_t version = fiftySecondTestTree.get_version();
+
+    // The listener is called after every change, with the new version already set
+    vector<uint64_t> notified;
+    fiftySecondTestTree.set_change_listener([&] { notified.push_back(fiftySecondTestTree.get_version()); });
+
+    Node<int> &root = fiftySecondTestTree.create_node(5);
+    CHECK(fiftySecondTestTree.get_version() == version); // Creating a node does not change the tree
+
+    fiftySecondTestTree.add_root(root);
+    CHECK(fiftySecondTestTree.get_version() > version);
+    version = fiftySecondTestTree.get_version();
+
+    Node<int> &child = fiftySecondTestTree.create_node(3);
+    fiftySecondTestTree.add_sub_node(root, child);
+    CHECK(fiftySecondTestTree.get_version() > version);
+    version = fiftySecondTestTree.get_version();
+
+    fiftySecondTestTree.add_sub_node_direct(child, fiftySecondTestTree.create_node(1));
+    CHECK(fiftySecondTestTree.get_version() > version);
+    version = fiftySecondTestTree.get_version();
+
+    // Reading does not change it, moving the values does
+    fiftySecondTestTree.for_each_pre_order([](Node<int> &) {});
+    CHECK(fiftySecondTestTree.get_version() == version);
+    fiftySecondTestTree.myHeap();
+    CHECK(fiftySecondTestTree.get_version() > version);
+    version = fiftySecondTestTree.get_version();
+
+    fiftySecondTestTree.build_from_parents(vector<int>{1, 2}, vector<long>{-1, 0});
+    CHECK(fiftySecondTestTree.get_version() > version);
+    version = fiftySecondTestTree.get_version();
+
+    // A moved tree is a different tree for whoever watched either of them
+    Tree<int> fiftyThirdTestTree(move(fiftySecondTestTree));
+    CHECK(fiftyThirdTestTree.get_version() == version);
+    CHECK(fiftySecondTestTree.get_version() != version);
+
+    fiftyThirdTestTree.clear();
+    CHECK(fiftyThirdTestTree.get_version() > version);
+
+    // add_root, add_sub_node, add_sub_node_direct, myHeap, build_from_parents and the move,
+    // the listener stayed with the moved-from tree so clearing the new one is not notified
+    CHECK(notified.size() == 6);
+    CHECK(is_sorted(notified.begin(), notified.end()));
+    CHECK(adjacent_find(notified.begin(), notified.end()) == notified.end());
+    CHECK(notified.back() == fiftySecondTestTree.get_version());
+}
+
+TEST_CASE("Testing layout index") {
+    srand(23);
+    vector<int> values(3000);
+    vector<long> parents(3000);
+    for (int i = 0; i < 3000; ++i) {
+        values[i] = i;
+        parents[i] = i == 0 ? -1 : rand() % i;
+    }
+
+    Tree<int> fiftyFourthTestTree(3000);
+    fiftyFourthTestTree.build_from_parents(values, parents);
+    TreeLayout<Node<int>> layout;
+    layout.compute(fiftyFourthTestTree.get_root());
+
+    LayoutIndex<Node<int>> index;
+    index.build(layout);
+
+    // The subtree boxes find the same nodes as checking all of them
+    LayoutBounds bounds = layout.bounds();
+    for (int k = 0; k < 20; ++k) {
+        float x = bounds.left + (bounds.right - bounds.left) * (rand() % 100) / 100.f;
+        float y = bounds.top + (bounds.bottom - bounds.top) * (rand() % 100) / 100.f;
+        LayoutBounds area{x, y, x + 900.f, y + 800.f};
+
+        vector<uint32_t> found, expected;
+        index.for_each_in(area, [&](uint32_t i) { found.push_back(i); });
+        for (uint32_t i = 0; i < layout.size(); ++i) {
+            if (layout.x(i) >= area.left && layout.x(i) <= area.right && layout.y(i) >= area.top && layout.y(i) <= area.bottom) {
+                expected.push_back(i);
+            }
+        }
+        sort(found.begin(), found.end());
+        CHECK(found == expected);
+    }
+
+    // Subtree boxes hold all their nodes
+    for (uint32_t i = 1; i < layout.size(); ++i) {
+        const LayoutBounds &box = index.subtree_bounds(layout.parent(i));
+        CHECK((layout.x(i) >= box.left && layout.x(i) <= box.right && layout.y(i) <= box.bottom));
+    }
+
+    // With no smallest width every node is opened, and a huge one makes the whole tree one summary
+    size_t opened = 0, summaries = 0;
+    index.for_each_level_of_detail(bounds, 0.f, 0.f, [&](uint32_t) { ++opened; }, [&](uint32_t) { ++summaries; });
+    CHECK(opened == layout.size());
+    CHECK(summaries == 0);
+
+    opened = summaries = 0;
+    index.for_each_level_of_detail(bounds, 1e30f, 0.f, [&](uint32_t) { ++opened; }, [&](uint32_t i) { ++summaries; CHECK(i == 0); });
+    CHECK(opened == 0);
+    CHECK(summaries == 1);
+
+    // In between, no node is drawn twice and every cell of the area opens at most one node
+    float cell = (bounds.right - bounds.left) / 50.f;
+    vector<int> covered(layout.size(), 0);
+    map<pair<long, long>, int> openedInCell;
+    index.for_each_level_of_detail(bounds, cell, 0.f,
+        [&](uint32_t i) {
+            ++covered[i];
+            ++openedInCell[{lround(floor((layout.x(i) - bounds.left) / cell)), lround(floor((layout.y(i) - bounds.top) / cell))}];
+        },
+        [&](uint32_t i) {
+            CHECK(layout.first_child(i) != layout.NO_NODE);
+            for (uint32_t j = i; j < layout.size(); ++j) {
+                // A node is in the subtree of i if i is one of its ancestors
+                for (uint32_t up = j; up != layout.NO_NODE; up = layout.parent(up)) {
+                    if (up == i) {
+                        ++covered[j];
+                        break;
+                    }
+                }
+            }
+        });
+    CHECK(*max_element(covered.begin(), covered.end()) == 1);
+    for (const auto &opened : openedInCell) {
+        CHECK(opened.second == 1);
+    }
+
+    // An area away from the tree finds nothing
+    opened = 0;
+    LayoutBounds away{bounds.right + 1000.f, 0.f, bounds.right + 2000.f, 1000.f};
+    index.for_each_in(away, [&](uint32_t) { ++opened; });
+    index.for_each_level_of_detail(away, 0.f, 0.f, [&](uint32_t) { ++opened; }, [&](uint32_t) { ++opened; });
+    CHECK(opened == 0);
+
+    // The double tree of main.cpp at zoom 1 opens every node, with the chain 1.3 -> 1.6 that has no width
+    Tree<double> fiftySeventhTestTree(2);
+    fiftySeventhTestTree.build_from_parents(vector<double>{1.1, 1.2, 1.3, 1.4, 1.5, 1.6}, vector<long>{-1, 0, 0, 1, 1, 2});
+    TreeLayout<Node<double>> demoLayout;
+    demoLayout.compute(fiftySeventhTestTree.get_root());
+    LayoutIndex<Node<double>> demoIndex;
+    demoIndex.build(demoLayout);
+
+    // The sizes TreeRenderer passes with the default RenderStyle: summaries under 8 pixels, nodes of radius 50 with a 3 pixel outline
+    LayoutBounds demoBounds = demoLayout.bounds();
+    opened = summaries = 0;
+    demoIndex.for_each_level_of_detail(demoBounds, 8.f, 106.f,
+        [&](uint32_t) { ++opened; }, [&](uint32_t) { ++summaries; });
+    CHECK(opened == 6);
+    CHECK(summaries == 0);
+
+    // Adding nodes to the layout and the index one by one gives the boxes of an index built from scratch
+    vector<Node<int> *> leaves;
+    fiftyFourthTestTree.for_each_pre_order([&](Node<int> &node) {
+        if (node.get_children().empty()) leaves.push_back(&node);
+    });
+    for (int i = 0; i < 200; ++i) {
+        Node<int> *parent = leaves[rand() % leaves.size()];
+        Node<int> &added = fiftyFourthTestTree.create_node(3000 + i);
+        fiftyFourthTestTree.add_sub_node(*parent, added);
+        index.add_nodes(layout.add_node(parent, &added));
+    }
+
+    LayoutIndex<Node<int>> rebuilt;
+    rebuilt.build(layout);
+    float worst = 0.f;
+    for (uint32_t i = 0; i < layout.size(); ++i) {
+        LayoutBounds a = index.subtree_bounds(i), b = rebuilt.subtree_bounds(i);
+        worst = max({worst, fabs(a.left - b.left), fabs(a.right - b.right), fabs(a.bottom - b.bottom)});
+    }
+    CHECK(worst < 0.01f);
+
+    bounds = layout.bounds();
+    LayoutBounds middle{(bounds.left + bounds.right) / 2.f - 450.f, 1000.f, (bounds.left + bounds.right) / 2.f + 450.f, 1800.f};
+    vector<uint32_t> found, expected;
+    index.for_each_in(middle, [&](uint32_t i) { found.push_back(i); });
+    for (uint32_t i = 0; i < layout.size(); ++i) {
+        if (layout.x(i) >= middle.left && layout.x(i) <= middle.right && layout.y(i) >= middle.top && layout.y(i) <= middle.bottom) {
+            expected.push_back(i);
+        }
+    }
+    sort(found.begin(), found.end());
+    CHECK(!expected.empty());
+    CHECK(found == expected);
+}
+
+TEST_CASE("Testing frame stats") {
+    FrameStats stats;
+    CHECK(stats.frame_count() == 0);
+    CHECK(stats.average_ms() == 0.0);
+
+    // Three wake ups, two of them draw a frame
+    stats.wake();
+    stats.add_frame(4.0);
+    stats.wake();
+    stats.wake();
+    stats.add_frame(2.0);
+
+    CHECK(stats.wakeup_count() == 3);
+    CHECK(stats.frame_count() == 2);
+    CHECK(stats.last_ms() == 2.0);
+    CHECK(stats.slowest_ms() == 4.0);
+    CHECK(stats.total_ms() == 6.0);
+    CHECK(stats.average_ms() == 3.0);
+
+    stats.begin_frame();
+    stats.end_frame();
+    CHECK(stats.frame_count() == 3);
+    CHECK(stats.last_ms() >= 0.0);
+    CHECK(stats.slowest_ms() == 4.0);
+}
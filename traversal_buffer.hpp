@@ -0,0 +1,168 @@
+// noavrd@gmail.com
+
+#ifndef TRAVERSAL_BUFFER_HPP
+#define TRAVERSAL_BUFFER_HPP
+
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+/**
+ * TraversalBuffer class template
+ * 
+ * The stack (push / back / pop_back) or queue (push / front / pop_front) of the tree iterators.
+ * The first N items are kept inline, inside the iterator itself, so traversing a small tree does no heap allocation.
+ * When it needs more room it moves to a caller-supplied scratch vector (which can be reused between traversals),
+ * or to its own heap buffer if there isn't one.
+ * 
+ * @tparam P The item type (node pointers)
+ * @tparam N The number of inline items
+ */
+template <typename P, size_t N = 32>
+class TraversalBuffer {
+private:
+    P inlineItems[N];    // The inline storage
+    P *items;            // The storage in use - inlineItems, the scratch data or the heap data
+    size_t head;         // Index of the first item (only moves when used as a queue)
+    size_t count;        // Number of items
+    size_t capacity;     // Number of items that fit in the storage in use
+    vector<P> *scratch;  // Caller-supplied storage, or nullptr
+    vector<P> heapItems; // Own storage when there is no scratch
+
+    // Move the items to a bigger storage
+    void grow() {
+        vector<P> &buffer = scratch ? *scratch : heapItems;
+        size_t newCapacity = max(capacity * 2, buffer.size());
+
+        if (items == inlineItems) {
+            buffer.resize(newCapacity);
+            copy(inlineItems + head, inlineItems + head + count, buffer.begin());
+            head = 0;
+        } else {
+            buffer.resize(newCapacity);
+        }
+
+        items = buffer.data();
+        capacity = newCapacity;
+    }
+
+    // Copy the items of another buffer, always to inline or own storage - a scratch is never shared
+    void copy_from(const TraversalBuffer &other) {
+        const P *first = other.items + other.head;
+
+        scratch = nullptr;
+        head = 0;
+        count = other.count;
+
+        if (count <= N) {
+            copy(first, first + count, inlineItems);
+            items = inlineItems;
+            capacity = N;
+        } else {
+            heapItems.assign(first, first + count);
+            items = heapItems.data();
+            capacity = heapItems.size();
+        }
+    }
+
+    // Take the items of another buffer, which is left empty - the storage moves with them, so there is no copy
+    void move_from(TraversalBuffer &other) {
+        scratch = other.scratch;
+        head = other.head;
+        count = other.count;
+        capacity = other.capacity;
+
+        if (other.items == other.inlineItems) {
+            copy(other.inlineItems + other.head, other.inlineItems + other.head + other.count, inlineItems + other.head);
+            items = inlineItems;
+        } else if (other.items == other.heapItems.data()) {
+            heapItems = move(other.heapItems);
+            items = heapItems.data();
+        } else {
+            items = other.items;
+        }
+
+        other.items = other.inlineItems;
+        other.scratch = nullptr;
+        other.head = 0;
+        other.count = 0;
+        other.capacity = N;
+    }
+
+public:
+    /**
+     * Constructor for a buffer that keeps its items inline, and on the heap if there are more than N
+     * 
+     * @param scratch Optional caller-supplied storage for more than N items
+     */
+    explicit TraversalBuffer(vector<P> *scratch = nullptr)
+        : items(inlineItems), head(0), count(0), capacity(N), scratch(scratch) {}
+
+    TraversalBuffer(const TraversalBuffer &other) {
+        copy_from(other);
+    }
+
+    TraversalBuffer &operator=(const TraversalBuffer &other) {
+        if (this != &other) {
+            copy_from(other);
+        }
+        return *this;
+    }
+
+    TraversalBuffer(TraversalBuffer &&other) noexcept {
+        move_from(other);
+    }
+
+    TraversalBuffer &operator=(TraversalBuffer &&other) noexcept {
+        if (this != &other) {
+            move_from(other);
+        }
+        return *this;
+    }
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+
+    P &back() { return items[head + count - 1]; }
+    const P &back() const { return items[head + count - 1]; }
+    P &front() { return items[head]; }
+    const P &front() const { return items[head]; }
+
+    void push(const P &item) {
+        if (head + count == capacity) {
+            // A queue that was popped a lot - move the items to the start instead of growing
+            if (head >= capacity / 2) {
+                copy(items + head, items + head + count, items);
+                head = 0;
+            } else {
+                grow();
+            }
+        }
+
+        items[head + count] = item;
+        ++count;
+    }
+
+    void pop_back() {
+        --count;
+    }
+
+    void pop_front() {
+        ++head;
+        --count;
+
+        if (count == 0) {
+            head = 0;
+        }
+    }
+};
+
+/**
+ * The end of every tree traversal
+ * 
+ * The end_*() functions of Tree return it instead of a full iterator, so comparing with the end costs nothing to build.
+ */
+struct TraversalEnd {};
+
+#endif // TRAVERSAL_BUFFER_HPP
@@ -0,0 +1,433 @@
+// noavrd@gmail.com
+
+#ifndef TRAVERSAL_WRITER_HPP
+#define TRAVERSAL_WRITER_HPP
+
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <charconv>
+#include <stdexcept>
+#include <type_traits>
+
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "complex.hpp"
+
+using namespace std;
+
+// The size of the buffer the traversal writer fills before each write
+constexpr size_t TRAVERSAL_WRITER_BUFFER_SIZE = 1 << 20;
+
+/**
+ * The output formats of the traversal writer
+ *
+ * text:       "############ title ############", then the values separated by ", " and an empty line,
+ *             numbers look like cout prints them (6 significant digits for floating point)
+ * json_lines: one {"traversal":title,"index":i,"value":v} object per line, a Complex is {"real":a,"imag":b}
+ * binary:     the title length (uint32) and the title, then runs of values - the run length (uint32) and the values -
+ *             ending with a run of length 0. Numbers and Complex are raw in the byte order of the machine,
+ *             a string is its length (uint32) and its characters
+ */
+enum class TraversalFormat {
+    text,
+    json_lines,
+    binary
+};
+
+/**
+ * TraversalWriter class
+ *
+ * Writes traversals to a file descriptor. The values are formatted into one big buffer (numbers with to_chars)
+ * that is written with a single write call when it is full, so a traversal costs one system call per chunk
+ * and not one per value. A string too big for the buffer is written with the buffer in one writev call.
+ * The buffer is kept between traversals.
+ *
+ * Call flush() at the end to see write errors - the destructor flushes too, but ignores them.
+ */
+class TraversalWriter {
+private:
+    int fd;
+    TraversalFormat format;
+    vector<char> buffer;
+    size_t used;          // The number of buffered bytes
+    size_t written;       // The number of bytes written to the file descriptor
+    bool inTraversal;
+    bool first;           // true until the first value of the traversal (text)
+    size_t index;         // The index of the next value in the traversal (JSON lines)
+    string linePrefix;    // {"traversal":title,"index": (JSON lines)
+    string quoted;        // The last string value, escaped and quoted (JSON lines)
+    size_t runStart;      // Where the length of the current run is in the buffer (binary)
+    uint32_t runCount;    // The number of values in the current run (binary)
+    bool runOpen;         // true if the buffer ends in a run that values are added to (binary)
+
+    // Write the buffer and an optional extra block with as few calls as possible
+    void write_out(const char *extra, size_t extraSize) {
+        iovec parts[2] = {{buffer.data(), used}, {const_cast<char *>(extra), extraSize}};
+        int count = extraSize ? 2 : 1;
+        iovec *part = parts;
+
+        while (count > 0) {
+            if (part->iov_len == 0) {
+                ++part;
+                --count;
+                continue;
+            }
+
+            ssize_t result = count == 1 ? ::write(fd, part->iov_base, part->iov_len) : ::writev(fd, part, count);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw runtime_error("############ Error: Can't write the traversal... ############");
+            }
+
+            written += static_cast<size_t>(result);
+            for (size_t left = static_cast<size_t>(result); left > 0 && count > 0;) {
+                size_t step = min(left, part->iov_len);
+                part->iov_base = static_cast<char *>(part->iov_base) + step;
+                part->iov_len -= step;
+                left -= step;
+                if (part->iov_len == 0) {
+                    ++part;
+                    --count;
+                }
+            }
+        }
+
+        used = 0;
+    }
+
+    void open_run() {
+        runStart = used;
+        used += sizeof(uint32_t);
+        runCount = 0;
+        runOpen = true;
+    }
+
+    // An empty run would end the traversal, so it is dropped
+    void close_run() {
+        if (!runOpen) {
+            return;
+        }
+
+        if (runCount == 0) {
+            used = runStart;
+        } else {
+            memcpy(buffer.data() + runStart, &runCount, sizeof(runCount));
+        }
+        runOpen = false;
+    }
+
+    // Write out the buffered chunk. A binary run ends with it, and the next value of the traversal starts a new one,
+    // so what was written always ends between runs and nothing is left in the buffer
+    void write_chunk(const char *extra = nullptr, size_t extraSize = 0) {
+        close_run();
+        write_out(extra, extraSize);
+    }
+
+    // Make room for a binary value of size bytes, in the open run or a new one
+    void reserve_in_run(size_t size) {
+        if (runOpen && used + size > buffer.size()) {
+            write_chunk();
+        }
+        if (!runOpen) {
+            reserve(sizeof(uint32_t) + size);
+            open_run();
+        }
+    }
+
+    // Make room for size bytes in the buffer
+    char *reserve(size_t size) {
+        if (used + size > buffer.size()) {
+            write_chunk();
+        }
+        return buffer.data() + used;
+    }
+
+    void put(const char *data, size_t size) {
+        while (size > 0) {
+            size_t step = min(size, buffer.size() - used);
+            memcpy(buffer.data() + used, data, step);
+            used += step;
+            data += step;
+            size -= step;
+            if (size > 0) {
+                write_chunk();
+            }
+        }
+    }
+
+    void put(const string &text) {
+        put(text.data(), text.size());
+    }
+
+    template <typename N>
+    void put_raw(const N &value) {
+        memcpy(reserve(sizeof(value)), &value, sizeof(value));
+        used += sizeof(value);
+    }
+
+    template <typename N>
+    void put_number(N value) {
+        // Enough for any integer and for the shortest form of any double
+        constexpr size_t MAX_NUMBER_SIZE = 32;
+        char *first = reserve(MAX_NUMBER_SIZE);
+        used = to_chars(first, first + MAX_NUMBER_SIZE, value).ptr - buffer.data();
+    }
+
+    // Like cout with its default precision: printf's %g with 6 significant digits
+    template <typename N>
+    void put_text_number(N value) {
+        if constexpr (is_floating_point<N>::value) {
+            constexpr size_t MAX_NUMBER_SIZE = 32;
+            char *first = reserve(MAX_NUMBER_SIZE);
+            used = to_chars(first, first + MAX_NUMBER_SIZE, value, chars_format::general, 6).ptr - buffer.data();
+        } else {
+            put_number(value);
+        }
+    }
+
+    // JSON has no infinity or NaN
+    template <typename N>
+    void put_json_number(N value) {
+        if constexpr (is_floating_point<N>::value) {
+            if (!isfinite(value)) {
+                put("null", 4);
+                return;
+            }
+        }
+        put_number(value);
+    }
+
+    static void append_json_string(string &out, const char *text, size_t size) {
+        static const char hex[] = "0123456789abcdef";
+        out += '"';
+        for (size_t i = 0; i < size; ++i) {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += static_cast<char>(c);
+            } else if (c < 0x20) {
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 15];
+            } else {
+                out += static_cast<char>(c);
+            }
+        }
+        out += '"';
+    }
+
+    template <typename T>
+    void put_text_value(const T &value) {
+        if constexpr (is_same<T, string>::value) {
+            if (value.size() > buffer.size() - used) {
+                write_chunk(value.data(), value.size());
+            } else {
+                put(value);
+            }
+        } else if constexpr (is_same<T, Complex>::value) {
+            put_text_number(value.get_real());
+            put(" + ", 3);
+            put_text_number(value.get_imag());
+            put("i", 1);
+        } else {
+            static_assert(is_arithmetic<T>::value, "Traversal values can be numbers, strings or Complex");
+            put_text_number(value);
+        }
+    }
+
+    template <typename T>
+    void put_json_value(const T &value) {
+        if constexpr (is_same<T, string>::value) {
+            quoted.clear();
+            append_json_string(quoted, value.data(), value.size());
+            put(quoted);
+        } else if constexpr (is_same<T, Complex>::value) {
+            put("{\"real\":", 8);
+            put_json_number(value.get_real());
+            put(",\"imag\":", 8);
+            put_json_number(value.get_imag());
+            put("}", 1);
+        } else {
+            static_assert(is_arithmetic<T>::value, "Traversal values can be numbers, strings or Complex");
+            put_json_number(value);
+        }
+    }
+
+    template <typename T>
+    void put_binary_value(const T &value) {
+        if constexpr (is_same<T, string>::value) {
+            uint32_t size = static_cast<uint32_t>(value.size());
+            reserve_in_run(sizeof(size));
+            ++runCount;
+            put_raw(size);
+            if (value.size() > buffer.size() - used) {
+                write_chunk(value.data(), value.size());
+            } else {
+                put(value);
+            }
+        } else {
+            static_assert(is_arithmetic<T>::value || is_same<T, Complex>::value, "Traversal values can be numbers, strings or Complex");
+            reserve_in_run(sizeof(value));
+            ++runCount;
+            put_raw(value);
+        }
+    }
+
+public:
+    /**
+     * Constructs a writer
+     *
+     * @param fd The file descriptor to write to (like STDOUT_FILENO), it is not closed by the writer
+     * @param format The output format
+     * @param bufferSize The size of the buffer (at least 64 bytes)
+     */
+    explicit TraversalWriter(int fd, TraversalFormat format = TraversalFormat::text, size_t bufferSize = TRAVERSAL_WRITER_BUFFER_SIZE)
+        : fd(fd), format(format), buffer(max<size_t>(bufferSize, 64)), used(0), written(0),
+          inTraversal(false), first(true), index(0), runStart(0), runCount(0), runOpen(false) {}
+
+    TraversalWriter(const TraversalWriter &) = delete;
+    TraversalWriter &operator=(const TraversalWriter &) = delete;
+
+    ~TraversalWriter() {
+        try {
+            flush();
+        } catch (const runtime_error &) {
+        }
+    }
+
+    /**
+     * Starts a traversal
+     *
+     * @param title The name of the traversal
+     */
+    void begin_traversal(const string &title) {
+        if (inTraversal) {
+            end_traversal();
+        }
+
+        switch (format) {
+        case TraversalFormat::text:
+            put("############ ", 13);
+            put(title);
+            put(" ############\n", 14);
+            break;
+        case TraversalFormat::json_lines:
+            linePrefix = "{\"traversal\":";
+            append_json_string(linePrefix, title.data(), title.size());
+            linePrefix += ",\"index\":";
+            break;
+        case TraversalFormat::binary:
+            put_raw(static_cast<uint32_t>(title.size()));
+            put(title);
+            break;
+        }
+
+        inTraversal = true;
+        first = true;
+        index = 0;
+    }
+
+    /**
+     * Writes the next value of the traversal
+     *
+     * @param value A number, a string or a Complex
+     */
+    template <typename T>
+    void write_value(const T &value) {
+        switch (format) {
+        case TraversalFormat::text:
+            if (!first) {
+                put(", ", 2);
+            }
+            put_text_value(value);
+            break;
+        case TraversalFormat::json_lines:
+            put(linePrefix);
+            put_number(index);
+            put(",\"value\":", 9);
+            put_json_value(value);
+            put("}\n", 2);
+            break;
+        case TraversalFormat::binary:
+            put_binary_value(value);
+            break;
+        }
+
+        first = false;
+        ++index;
+    }
+
+    /**
+     * Ends the traversal
+     */
+    void end_traversal() {
+        if (!inTraversal) {
+            return;
+        }
+
+        inTraversal = false;
+
+        if (format == TraversalFormat::text) {
+            put("\n\n", 2);
+        } else if (format == TraversalFormat::binary) {
+            close_run();
+            put_raw(uint32_t(0));
+        }
+    }
+
+    /**
+     * Writes a whole traversal
+     *
+     * @param title The name of the traversal
+     * @param begin An iterator to the first node
+     * @param end The end of the traversal
+     */
+    template <typename Iterator, typename End>
+    void write_traversal(const string &title, Iterator begin, End end) {
+        begin_traversal(title);
+        for (; begin != end; ++begin) {
+            write_value(begin->get_value());
+        }
+        end_traversal();
+    }
+
+    /**
+     * Writes everything that is buffered, the buffer is empty after it
+     *
+     * A traversal that was not ended stays open, its next values go in a new run.
+     *
+     * @throws runtime_error if the file descriptor can't be written
+     */
+    void flush() {
+        if (used > 0) {
+            write_chunk();
+        }
+    }
+
+    /**
+     * Returns the number of bytes written to the file descriptor so far (not counting the buffered ones)
+     *
+     * @return size_t The number of bytes
+     */
+    size_t bytes_written() const {
+        return written;
+    }
+
+    /**
+     * Returns the number of bytes in the buffer that are not written yet, 0 after flush()
+     *
+     * @return size_t The number of bytes
+     */
+    size_t bytes_buffered() const {
+        return used;
+    }
+};
+
+#endif // TRAVERSAL_WRITER_HPP
@@ -9,27 +9,118 @@
 #include <vector>
 #include <stdexcept>
 #include <algorithm>
-#include <SFML/Graphics.hpp>
-#include <map>
-#include <sstream>
 #include <functional>
+#include <unordered_map>
 
 #include "complex.hpp"
 #include "node.hpp"
+#include "arena.hpp"
+#include "frozen_tree.hpp"
+#include "traversal_buffer.hpp"
+#include "parallel.hpp"
+#include "compare.hpp"
+
+// Asks the CPU to start loading a node that is visited soon, nothing on compilers without __builtin_prefetch
+#if defined(__GNUC__) || defined(__clang__)
+#define TREE_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define TREE_PREFETCH(address) ((void)0)
+#endif
 
 using namespace std;
 
+// A read-only tree over a tree file, in tree_file.hpp - include it to save and load trees
+template <typename T>
+class MappedTree;
+
 /** 
  * Tree class template
  * 
  * A generic tree where each node can have up to 'maxChildren' children.
  * It has differnet iterators for tree traversal and methods to change the tree.
+ * 
+ * Nodes can be given from outside (and are not owned by the tree), or created with create_node,
+ * in which case they are allocated by the Allocator policy and freed with the tree.
+ * 
+ * @tparam T The type of the values in the tree
+ * @tparam K The children capacity of the nodes (Node<T, K>), or dynamic_arity (the default) to keep the children in a vector
+ * @tparam Allocator The node allocator policy (NodeArena by default, or HeapAllocator)
+ * @tparam Hash The hash function of the value index - std::hash by default, called directly (not through a function pointer)
  */
-template <typename T>
+template <typename T, size_t K = dynamic_arity, template <typename> class Allocator = NodeArena, typename Hash = hash<T>>
 class Tree {
+public:
+    // The type of the tree nodes
+    using NodeType = Node<T, K>;
+
 private:
-    Node<T> *root; // The tree root node
+    NodeType *root; // The tree root node
     size_t maxChildren;      // Max number of children
+    Allocator<NodeType> nodeAllocator; // Owns the nodes made by create_node
+
+    // Optional index from value to the nodes holding it, only kept when indexed is true
+    bool indexed;
+    unordered_multimap<T, NodeType *, Hash> index;
+
+    // The order myHeap() converted the whole tree to (see order_id), nullptr if none or the tree changed since
+    const void *heapOrder;
+
+    // Counts the changes of the tree (its structure or values), so views of it know when to rebuild
+    uint64_t version;
+
+    // Called after every change, so a view that sleeps until something happens can be woken (see set_change_listener)
+    function<void()> changeListener;
+
+    void notify_change() {
+        if (changeListener) {
+            changeListener();
+        }
+    }
+
+    // The biggest k for which top_k streams the values through a bounded heap instead of gathering all of them
+    static constexpr size_t TOP_K_HEAP_LIMIT = 1024;
+
+    /**
+     * A helper function that adds all the nodes of a given subtree to the index
+     *
+     * @param node Pointer to the root of the subtree to add
+     */
+    void index_subtree(NodeType *node) {
+        stack<NodeType *> nodes;
+        nodes.push(node);
+
+        while (!nodes.empty()) {
+            NodeType *current = nodes.top();
+            nodes.pop();
+
+            index.emplace(current->get_value(), current);
+
+            for (auto child : current->get_children()) {
+                if (child)
+                    nodes.push(child);
+            }
+        }
+    }
+
+    /**
+     * A helper function that finds the indexed node for a given node
+     * 
+     * Prefers the node itself if it is in the tree, and otherwise any node with an equal value
+     *
+     * @param node The node to look for
+     * 
+     * @return Pointer to the matching node in the tree, or nullptr if there isn't one
+     */
+    NodeType *find_indexed(const NodeType &node) const {
+        auto range = index.equal_range(node.get_value());
+        if (range.first == range.second) { return nullptr; }
+
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == &node) { return it->second; }
+        }
+
+        return range.first->second;
+    }
 
     /**
      * A recursive helper function that finds a node according to a given number
@@ -39,12 +130,12 @@ private:
      * 
      * @return Pointer to the node containing the wanted value, or nullptr if there isn't one
      */
-    Node<T> *find_node(Node<T> *currentNode, const T &value) const {
+    NodeType *find_node(NodeType *currentNode, const T &value) const {
         if (currentNode->get_value() == value) { return currentNode; }
              
         for (auto child : currentNode->get_children()) {
             if (child) {
-                Node<T> *foundNode = find_node(child, value);
+                NodeType *foundNode = find_node(child, value);
 
                 if (foundNode)
                     return foundNode;
@@ -54,26 +145,189 @@ private:
         return nullptr;
     }
 
+#ifdef TREE_DEBUG
+    /**
+     * A helper function that checks if a given node is part of the subtree of currentNode
+     * Only used for the debug checks of add_sub_node_direct
+     *
+     * @param currentNode Pointer to the root of the subtree to search in
+     * @param node Pointer to the wanted node
+     * 
+     * @return true if the node is in the subtree, false if not
+     */
+    bool contains_node(NodeType *currentNode, const NodeType *node) const {
+        stack<NodeType *> nodes;
+        nodes.push(currentNode);
+
+        while (!nodes.empty()) {
+            NodeType *current = nodes.top();
+            nodes.pop();
+
+            if (current == node) { return true; }
+
+            for (auto child : current->get_children()) {
+                if (child)
+                    nodes.push(child);
+            }
+        }
+
+        return false;
+    }
+#endif
+
 public:
+    // The compile-time arity of the tree, or dynamic_arity if it is only known at runtime
+    static constexpr size_t arity = K;
+
     /**
      * Constructor to initialize the tree with a given maximum number of children
-     * @param maxChildren Maximum number of children per node - for binary trees the default is 2
+     * @param maxChildren Maximum number of children per node - for binary trees the default is 2,
+     *                    for a compile-time arity it must be K (the default)
+     * 
+     * @throws runtime_error if the tree has a compile-time arity and maxChildren is different
+     */
+    explicit Tree(size_t maxChildren = (K == dynamic_arity ? 2 : K)) : root(nullptr), maxChildren(maxChildren), indexed(false), heapOrder(nullptr), version(0) {
+        if (K != dynamic_arity && maxChildren != K) {
+            throw runtime_error("############ Error: The arity of the tree is fixed... ############");
+        }
+    }
+
+    /**
+     * @return The maximum number of children per node, a constant when the tree has a compile-time arity
      */
-    explicit Tree(size_t maxChildren = 2) : root(nullptr), maxChildren(maxChildren) {}
+    constexpr size_t max_children() const {
+        if constexpr (K != dynamic_arity) {
+            return K;
+        } else {
+            return maxChildren;
+        }
+    }
+
+    // The tree owns its created nodes, so it can be moved but not copied
+    Tree(const Tree &) = delete;
+    Tree &operator=(const Tree &) = delete;
+
+    Tree(Tree &&other) noexcept
+        : root(other.root), maxChildren(other.maxChildren), nodeAllocator(move(other.nodeAllocator)),
+          indexed(other.indexed), index(move(other.index)), heapOrder(other.heapOrder), version(other.version) {
+        other.root = nullptr;
+        other.indexed = false;
+        other.heapOrder = nullptr;
+        ++other.version;
+        other.notify_change();
+    }
+
+    Tree &operator=(Tree &&other) noexcept {
+        if (this != &other) {
+            root = other.root;
+            maxChildren = other.maxChildren;
+            nodeAllocator = move(other.nodeAllocator);
+            indexed = other.indexed;
+            index = move(other.index);
+            heapOrder = other.heapOrder;
+            version = max(version, other.version) + 1;
+
+            other.root = nullptr;
+            other.indexed = false;
+            other.heapOrder = nullptr;
+            ++other.version;
+            other.notify_change();
+            notify_change();
+        }
+        return *this;
+    }
+
+    /**
+     * Create a new node that is owned by the tree
+     * 
+     * The node is allocated by the tree allocator and freed together with the tree (or by clear),
+     * it still has to be added with add_root or add_sub_node.
+     * 
+     * @param value The value for the new node
+     * @return Reference to the new node
+     */
+    NodeType &create_node(const T &value) {
+        return *nodeAllocator.allocate(value);
+    }
+
+    /**
+     * @return The number of nodes that were created by the tree
+     */
+    size_t owned_nodes() const {
+        return nodeAllocator.size();
+    }
+
+    /**
+     * Free the owned nodes that were created after the first ones, like the nodes of a failed load
+     *
+     * The freed nodes must not be in the tree.
+     *
+     * @param kept The number of owned nodes to keep (a past owned_nodes())
+     */
+    void release_nodes_after(size_t kept) {
+        nodeAllocator.release_after(kept);
+    }
+
+    /**
+     * Remove all the nodes from the tree and free all the nodes it owns in one call
+     */
+    void clear() {
+        root = nullptr;
+        heapOrder = nullptr;
+        ++version;
+
+        if (indexed) {
+            index.clear();
+        }
+
+        nodeAllocator.release();
+        notify_change();
+    }
 
     /**
      * Set the tree root node
      * @param node The future root node
      */
-    void add_root(Node<T> &node) {
+    void add_root(NodeType &node) {
         root = &node;
+        heapOrder = nullptr;
+        ++version;
+
+        if (indexed) {
+            index.clear();
+            index_subtree(root);
+        }
+        notify_change();
+    }
+
+    /**
+     * Get the version of the tree, it changes whenever nodes are added or values are moved (by myHeap)
+     * 
+     * Values changed through the nodes themselves are not counted.
+     * 
+     * @return The version number
+     */
+    uint64_t get_version() const {
+        return version;
+    }
+
+    /**
+     * Set a function that is called after every change that moves the version
+     *
+     * It is called on the thread that changed the tree, after the change is done. A window can use it
+     * to wake up from waiting for events. The listener stays with this tree object when the tree is moved.
+     *
+     * @param listener The function, an empty one to remove it
+     */
+    void set_change_listener(function<void()> listener) {
+        changeListener = move(listener);
     }
 
     /**
      * Get the tree root node
      * @return Pointer to the root node
      */
-    Node<T> *get_root() const {
+    NodeType *get_root() const {
         return root;
     }
 
@@ -85,27 +339,275 @@ public:
      * 
      * @throws runtime_error if the root is not set or the parent node is not found
      */
-    void add_sub_node(Node<T> &parent, Node<T> &child) {
+    void add_sub_node(NodeType &parent, NodeType &child) {
         if (!root) {
             throw runtime_error("############ Error: There is no root.... ############");
         }
 
-        Node<T> *parentNode = find_node(root, parent.get_value());
+        NodeType *parentNode = indexed ? find_indexed(parent) : find_node(root, parent.get_value());
 
         if (!parentNode) {
             throw runtime_error("############ Error: There is no parent to the node... ############");
         } 
 
-        parentNode->add_sub_node(&child, maxChildren);
+        parentNode->add_sub_node(&child, max_children());
+        heapOrder = nullptr;
+        ++version;
 
+        if (indexed) {
+            index_subtree(&child);
+        }
+        notify_change();
+    }
+
+    /**
+     * Add a child directly under a given parent node, without searching the tree for the parent
+     * 
+     * Unlike add_sub_node, the parent is used as is, so the insert costs O(1).
+     * When compiled with TREE_DEBUG, it also checks that the parent is really part of this tree.
+     * 
+     * @param parent Parent node to add the child, must already be in the tree
+     * @param child Child node to be added
+     * 
+     * @throws runtime_error if the root is not set, the parent is not in the tree (TREE_DEBUG only)
+     *         or the parent already has the maximum number of children
+     */
+    void add_sub_node_direct(NodeType &parent, NodeType &child) {
+        if (!root) {
+            throw runtime_error("############ Error: There is no root.... ############");
+        }
+
+#ifdef TREE_DEBUG
+        if (indexed ? find_indexed(parent) != &parent : !contains_node(root, &parent)) {
+            throw runtime_error("############ Error: There is no parent to the node... ############");
+        }
+#endif
+
+        parent.add_sub_node(&child, max_children());
+        heapOrder = nullptr;
+        ++version;
+
+        if (indexed) {
+            index_subtree(&child);
+        }
+        notify_change();
+    }
+
+    /**
+     * Build the whole tree in one linear pass from a parent index array
+     * 
+     * parents[i] is the index in nodes of the parent of nodes[i], or -1 for the root.
+     * Every parent must come before its children, and the children of each node are added by their index order.
+     * 
+     * @param nodes The nodes of the tree
+     * @param parents The parent index of each node, -1 for the root
+     * 
+     * @throws runtime_error if the sizes don't match, there isn't exactly one root,
+     *         a parent index is invalid or a node has too many children
+     */
+    void build_from_parents(const vector<NodeType *> &nodes, const vector<long> &parents) {
+        if (nodes.size() != parents.size()) {
+            throw runtime_error("############ Error: The number of nodes and parents is not matching... ############");
+        }
+
+        NodeType *newRoot = nullptr;
+
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (parents[i] < 0) {
+                if (newRoot) {
+                    throw runtime_error("############ Error: There is more than one root... ############");
+                }
+                newRoot = nodes[i];
+            } else if (static_cast<size_t>(parents[i]) >= i) {
+                throw runtime_error("############ Error: The parent must come before the node... ############");
+            } else {
+                nodes[parents[i]]->add_sub_node(nodes[i], max_children());
+            }
+        }
+
+        if (!newRoot && !nodes.empty()) {
+            throw runtime_error("############ Error: There is no root.... ############");
+        }
+
+        root = newRoot;
+        heapOrder = nullptr;
+        ++version;
+
+        if (indexed) {
+            index.clear();
+            if (root) {
+                index_subtree(root);
+            }
+        }
+        notify_change();
+    }
+
+    /**
+     * Build the whole tree in one linear pass from values and a parent index array
+     * 
+     * The nodes are created by the tree allocator, in the same order as the values.
+     * 
+     * @param values The values of the nodes
+     * @param parents The parent index of each value, -1 for the root
+     * 
+     * @throws runtime_error on the same cases as the nodes version
+     */
+    void build_from_parents(const vector<T> &values, const vector<long> &parents) {
+        vector<NodeType *> nodes;
+        nodes.reserve(values.size());
+
+        for (const auto &value : values) {
+            nodes.push_back(&create_node(value));
+        }
+
+        build_from_parents(nodes, parents);
+    }
+
+    /**
+     * Turn on the index mode, which keeps a hash index from value to nodes
+     * 
+     * In index mode find_node and the parent search of add_sub_node take constant time,
+     * and add_sub_node uses the exact parent node that was passed when it is in the tree.
+     * 
+     * @param hasher The hash function for the values
+     */
+    void enable_index(const Hash &hasher = Hash()) {
+        index = unordered_multimap<T, NodeType *, Hash>(0, hasher);
+        indexed = true;
+
+        if (root) {
+            index_subtree(root);
+        }
+    }
+
+    /**
+     * Turn off the index mode and free the index memory
+     */
+    void disable_index() {
+        index = unordered_multimap<T, NodeType *, Hash>();
+        indexed = false;
+    }
+
+    /**
+     * @return true if the tree keeps a value index, false if not
+     */
+    bool is_indexed() const {
+        return indexed;
+    }
+
+    /**
+     * Estimate the memory used by the index, to decide if it is worth it for a tree
+     * 
+     * Counts the buckets and the map entries, not memory owned by the values themselves (like string buffers)
+     * 
+     * @return The estimated index size in bytes, 0 if the tree is not indexed
+     */
+    size_t index_memory_usage() const {
+        if (!indexed) { return 0; }
+
+        // Each entry holds the value, the node pointer, the next pointer and the cached hash
+        size_t entrySize = sizeof(pair<const T, NodeType *>) + sizeof(void *) + sizeof(size_t);
+        return sizeof(index) + index.bucket_count() * sizeof(void *) + index.size() * entrySize;
+    }
+
+    /**
+     * Find a node with a given value
+     * 
+     * Takes constant time in index mode, otherwise searches the tree from the root
+     * 
+     * When more than one node holds the value, the search returns the first one in pre-order,
+     * and the index returns any one of them (not always the first in pre-order)
+     * 
+     * @param value The value to search for in the tree
+     * 
+     * @return Pointer to a node containing the wanted value, or nullptr if there isn't one
+     */
+    NodeType *find_node(const T &value) const {
+        if (indexed) {
+            auto it = index.find(value);
+            return it == index.end() ? nullptr : it->second;
+        }
+
+        return root ? find_node(root, value) : nullptr;
     }
 
     // Template to prevent adding a child to a parent when both have differnet types
-    template <typename U>
-    void add_sub_node(Node<T> &parent, Node<U> &child) {
+    template <typename U, size_t J>
+    void add_sub_node(NodeType &parent, Node<U, J> &child) {
         throw runtime_error("############ Error: The type of the child node is not matching to the parent type... ############");
     }
 
+    /**
+     * Make an immutable snapshot of the tree for fast read-only traversal
+     * 
+     * The snapshot copies the values, so later changes to the tree don't affect it.
+     * 
+     * @return The frozen tree, with the values in pre-order and the structure in index arrays
+     */
+    FrozenTree<T> freeze() const {
+        return FrozenTree<T>(root, max_children() == 2);
+    }
+
+    /**
+     * Save the tree to a binary tree file (see tree_file.hpp), to load it back with load or load_mmap
+     * 
+     * Only trees of trivially copyable values (like int, double and Complex) or strings can be saved.
+     * Saving and loading need tree_file.hpp to be included, so the other users of the tree don't get the system headers of mmap.
+     * 
+     * @param path The file path
+     * 
+     * @throws runtime_error if the file can't be written
+     */
+    void save(const string &path) const {
+        // The file only holds the pre-order structure, so the other orders are not built
+        save_tree_file(FrozenTree<T>(root, false, false), max_children(), path);
+    }
+
+    /**
+     * Open a tree file as a read-only tree, without reading or allocating anything per node
+     * 
+     * @param path The file path
+     * @param verify true to check the whole structure of the file first (see MappedTree::verify), which reads all of it
+     * @return The read-only tree over the mapped file
+     * 
+     * @throws runtime_error if the file can't be mapped, is not a tree file of this value type or is damaged
+     */
+    static MappedTree<T> load_mmap(const string &path, bool verify = false) {
+        return MappedTree<T>(path, verify);
+    }
+
+    /**
+     * Replace the tree with the tree in a tree file, built in one pass with build_from_parents
+     * 
+     * The file is checked whole first, since all of it is read anyway. The nodes the tree owns are freed
+     * (like clear) before the new ones are created; on an error the tree is not changed.
+     * 
+     * @param path The file path
+     * 
+     * @throws runtime_error if the file can't be loaded, or the saved tree has more children per node than this one allows
+     */
+    void load(const string &path) {
+        MappedTree<T> saved(path, true);
+
+        if (saved.arity() > max_children()) {
+            throw runtime_error("############ Error: The saved tree has too much children... ############");
+        }
+
+        vector<T> values;
+        vector<long> parents;
+        values.reserve(saved.size());
+        parents.reserve(saved.size());
+
+        for (uint32_t i = 0; i < saved.size(); ++i) {
+            values.push_back(T(saved.value(i)));
+            parents.push_back(saved.parent(i) == saved.NO_NODE ? -1 : static_cast<long>(saved.parent(i)));
+        }
+
+        clear();
+        build_from_parents(values, parents);
+    }
+
+    // The nodes made by create_node are freed by the allocator
     ~Tree() {}
 
     /** 
@@ -114,11 +616,12 @@ public:
      */
     class preOrderIterator {
     private:
-        stack<Node<T> *> nodes;
+        TraversalBuffer<NodeType *> nodes;
         size_t maxChildren;
 
     public:
-        explicit preOrderIterator(Node<T> *node, size_t maxChildren) : maxChildren(maxChildren) {
+        explicit preOrderIterator(NodeType *node, size_t maxChildren, vector<NodeType *> *scratch = nullptr)
+            : nodes(scratch), maxChildren(maxChildren) {
             if (node) { 
                 nodes.push(node); 
             }
@@ -128,17 +631,25 @@ public:
             return !nodes.empty() != !other.nodes.empty();
         }
 
-        Node<T> *operator->() const {
-            return nodes.top();
+        bool operator!=(const TraversalEnd &) const {
+            return !nodes.empty();
+        }
+
+        bool operator==(const TraversalEnd &) const {
+            return nodes.empty();
+        }
+
+        NodeType *operator->() const {
+            return nodes.back();
         }
 
-        Node<T> &operator*() const {
-            return *nodes.top();
+        NodeType &operator*() const {
+            return *nodes.back();
         }
 
         preOrderIterator &operator++() {
-            const auto &children = nodes.top()->get_children();
-            nodes.pop();
+            const auto &children = nodes.back()->get_children();
+            nodes.pop_back();
 
             for (auto child = children.rbegin(); child != children.rend(); ++child) {
                 if (*child != nullptr)
@@ -154,27 +665,65 @@ public:
      * @return Pre-order iterator pointing to the root node
      */
     preOrderIterator begin_pre_order() const {
-        return preOrderIterator(root, maxChildren);
+        return preOrderIterator(root, max_children());
+    }
+
+    /**
+     * Get an iterator to the beginning of the pre-order traversal that keeps its stack in a caller buffer
+     * 
+     * The buffer is only used when the inline stack of the iterator is too small, and it can be
+     * reused between traversals, so after the first traversal there are no heap allocations at all.
+     * 
+     * @param scratch The buffer for the iterator stack
+     * @return Pre-order iterator pointing to the root node
+     */
+    preOrderIterator begin_pre_order(vector<NodeType *> &scratch) const {
+        return preOrderIterator(root, max_children(), &scratch);
     }
 
     /**
      * Get an iterator to the end of the pre-order traversal
-     * @return Pre-order iterator pointing to the end (nullptr)
+     * @return The end of the pre-order traversal (compares equal to a finished iterator)
      */
-    preOrderIterator end_pre_order() const {
-        return preOrderIterator(nullptr, maxChildren);
+    TraversalEnd end_pre_order() const {
+        return TraversalEnd();
     }
 
     /** 
      * In-order iterator class
      * Provides an iterator for traversing the tree in in-order (left, root, right) for binary trees.
+     * For other trees it goes in pre-order.
      */
     class inOrderIterator {
     private:
-        stack<Node<T> *> nodes;
+        TraversalBuffer<NodeType *> nodes;
         size_t maxChildren;
 
-        void add_left_child(Node<T> *node) {
+        // Checks if the tree is binary, without a runtime check when the arity is known at compile time
+        bool is_binary() const {
+            if constexpr (K != dynamic_arity) {
+                return K == 2;
+            } else {
+                return maxChildren == 2;
+            }
+        }
+
+        // Binary step: after a node comes the left branch of its right child
+        void add_right_child(const ChildSpan<NodeType> &children) {
+            if (children.size() > 1 && children[1] != nullptr) {
+                add_left_child(children[1]);
+            }
+        }
+
+        // Non binary step: the children come after the node, like in pre-order
+        void add_children(const ChildSpan<NodeType> &children) {
+            for (auto child = children.rbegin(); child != children.rend(); ++child) {
+                if (*child != nullptr)
+                    nodes.push(*child);
+            }
+        }
+
+        void add_left_child(NodeType *node) {
             while (node != nullptr) {
                 nodes.push(node);
 
@@ -187,15 +736,16 @@ public:
         }
 
     public:
-        explicit inOrderIterator(Node<T> *node, size_t maxChildren) : maxChildren(maxChildren) {
+        explicit inOrderIterator(NodeType *node, size_t maxChildren, vector<NodeType *> *scratch = nullptr)
+            : nodes(scratch), maxChildren(maxChildren) {
             if (node) {
-                if (maxChildren == 2) {
+                if (is_binary()) {
                     add_left_child(node);
                 } else {
                     nodes.push(node);
                      // Pop the top node if it's null
-                    while (!nodes.empty() && !nodes.top()) {
-                        nodes.pop(); 
+                    while (!nodes.empty() && !nodes.back()) {
+                        nodes.pop_back(); 
                     }
                 }
             }
@@ -205,12 +755,20 @@ public:
             return !nodes.empty() != !other.nodes.empty();
         }
 
-        Node<T> *operator->() const {
-            return nodes.top();
+        bool operator!=(const TraversalEnd &) const {
+            return !nodes.empty();
+        }
+
+        bool operator==(const TraversalEnd &) const {
+            return nodes.empty();
         }
 
-        Node<T> &operator*() const {
-            return *nodes.top();
+        NodeType *operator->() const {
+            return nodes.back();
+        }
+
+        NodeType &operator*() const {
+            return *nodes.back();
         }
 
         inOrderIterator &operator++() {
@@ -218,16 +776,17 @@ public:
                 return *this; 
             }
 
-            const auto &children = nodes.top()->get_children();    
-            nodes.pop();
+            const auto &children = nodes.back()->get_children();    
+            nodes.pop_back();
 
-            if (maxChildren == 2 && children.size() > 1 && children[1] != nullptr) {    
-                    add_left_child(children[1]);
+            if constexpr (K == 2) {
+                add_right_child(children);
+            } else if constexpr (K != dynamic_arity) {
+                add_children(children);
+            } else if (maxChildren == 2) {
+                add_right_child(children);
             } else {
-                for (auto child = children.rbegin(); child != children.rend(); ++child) {
-                    if (*child != nullptr)
-                        nodes.push(*child);
-                }
+                add_children(children);
             }
 
             return *this;
@@ -239,79 +798,102 @@ public:
      * @return In-order iterator pointing to the root node
      */
     inOrderIterator begin_in_order() const {
-        return inOrderIterator(root, maxChildren);
+        return inOrderIterator(root, max_children());
+    }
+
+    /**
+     * Get an iterator to the beginning of the in-order traversal that keeps its stack in a caller buffer
+     * 
+     * The buffer is only used when the inline stack of the iterator is too small, and it can be
+     * reused between traversals, so after the first traversal there are no heap allocations at all.
+     * 
+     * @param scratch The buffer for the iterator stack
+     * @return In-order iterator pointing to the root node
+     */
+    inOrderIterator begin_in_order(vector<NodeType *> &scratch) const {
+        return inOrderIterator(root, max_children(), &scratch);
     }
 
     /**
      * Get an iterator to the end of the in-order traversal
-     * @return In-order iterator pointing to the end (nullptr)
+     * @return The end of the in-order traversal (compares equal to a finished iterator)
      */
-    inOrderIterator end_in_order() const {
-        return inOrderIterator(nullptr, maxChildren);
+    TraversalEnd end_in_order() const {
+        return TraversalEnd();
     }
 
+    // A post-order stack frame: a node and the index of its next child to visit
+    using PostOrderFrame = pair<NodeType *, size_t>;
+
     /** 
      * Post-order iterator class
      * Provides an iterator for traversing the tree in post-order (children, root).
+     * 
+     * Every stack frame keeps the index of the next child of its node, so each step is amortized O(1)
+     * no matter how many children a node has.
      */
     class postOrderIterator {
     private:
-        Node<T> *currentNode;
+        NodeType *currentNode;
         size_t maxChildren;
-        stack<Node<T> *> nodes;
+        TraversalBuffer<PostOrderFrame> frames;
 
-        void add_left_child(Node<T> *node) {
-            while (node) {
-                nodes.push(node);
+        // Go down to the next node whose children were all visited, and make it the current node
+        void advance() {
+            while (!frames.empty()) {
+                PostOrderFrame &frame = frames.back();
+                const auto &children = frame.first->get_children();
 
-                if (!node->get_children().empty()) {
-                    node = node->get_children()[0];
+                // Skip missing children
+                while (frame.second < children.size() && children[frame.second] == nullptr) {
+                    ++frame.second;
+                }
+
+                if (frame.second < children.size()) {
+                    NodeType *child = children[frame.second++];
+                    frames.push(PostOrderFrame(child, 0));
                 } else {
-                    break;
+                    currentNode = frame.first;
+                    frames.pop_back();
+                    return;
                 }
             }
+
+            currentNode = nullptr;
         }
 
     public:
-        explicit postOrderIterator(Node<T> *node, size_t maxChildren) : currentNode(nullptr), maxChildren(maxChildren) {
+        explicit postOrderIterator(NodeType *node, size_t maxChildren, vector<PostOrderFrame> *scratch = nullptr)
+            : currentNode(nullptr), maxChildren(maxChildren), frames(scratch) {
             if (node) {
-                add_left_child(node);
+                frames.push(PostOrderFrame(node, 0));
             }
 
-            ++(*this);
+            advance();
         }
 
         bool operator!=(const postOrderIterator &other) const {
             return currentNode != other.currentNode;
         }
 
-        Node<T> *operator->() const {
+        bool operator!=(const TraversalEnd &) const {
+            return currentNode != nullptr;
+        }
+
+        bool operator==(const TraversalEnd &) const {
+            return currentNode == nullptr;
+        }
+
+        NodeType *operator->() const {
             return currentNode;
         }
 
-        Node<T> &operator*() const {
+        NodeType &operator*() const {
             return *currentNode;
         }
 
         postOrderIterator& operator++() {
-            if (nodes.empty()) {
-                currentNode = nullptr;
-                return *this;
-            }
-
-            Node<T>* node = nodes.top();
-            nodes.pop();
-
-            if (!nodes.empty()) {
-                const auto& parentChildren = nodes.top()->get_children();
-                auto child = find(parentChildren.begin(), parentChildren.end(), node);
-
-                if (child != parentChildren.end() && ++child != parentChildren.end()) {
-                    add_left_child(*child);
-                }
-            }
-
-            currentNode = node;
+            advance();
             return *this;
         }
 
@@ -322,15 +904,28 @@ public:
      * @return Post-order iterator pointing to the root node
      */
     postOrderIterator begin_post_order() const {
-        return postOrderIterator(root, maxChildren);
+        return postOrderIterator(root, max_children());
+    }
+
+    /**
+     * Get an iterator to the beginning of the post-order traversal that keeps its stack in a caller buffer
+     * 
+     * The buffer is only used when the inline stack of the iterator is too small, and it can be
+     * reused between traversals, so after the first traversal there are no heap allocations at all.
+     * 
+     * @param scratch The buffer for the iterator stack frames
+     * @return Post-order iterator pointing to the root node
+     */
+    postOrderIterator begin_post_order(vector<PostOrderFrame> &scratch) const {
+        return postOrderIterator(root, max_children(), &scratch);
     }
 
     /**
      * Get an iterator to the end of the post-order traversal
-     * @return Post-order iterator pointing to the end (nullptr)
+     * @return The end of the post-order traversal (compares equal to a finished iterator)
      */
-    postOrderIterator end_post_order() const {
-        return postOrderIterator(nullptr, maxChildren);
+    TraversalEnd end_post_order() const {
+        return TraversalEnd();
     }
 
     /** 
@@ -339,10 +934,10 @@ public:
      */
     class BFSIterator {
     private:
-        queue<Node<T> *> nodes;
+        TraversalBuffer<NodeType *> nodes;
 
     public:
-        explicit BFSIterator(Node<T> *node) {
+        explicit BFSIterator(NodeType *node, vector<NodeType *> *scratch = nullptr) : nodes(scratch) {
             if (node) { 
                 nodes.push(node);
             }
@@ -352,17 +947,25 @@ public:
             return !nodes.empty() != !other.nodes.empty();
         }
 
-        Node<T> *operator->() const {
+        bool operator!=(const TraversalEnd &) const {
+            return !nodes.empty();
+        }
+
+        bool operator==(const TraversalEnd &) const {
+            return nodes.empty();
+        }
+
+        NodeType *operator->() const {
             return nodes.front();
         }
 
-        Node<T> &operator*() const {
+        NodeType &operator*() const {
             return *nodes.front();
         }
 
         BFSIterator &operator++() {
-            Node<T> *current = nodes.front();
-            nodes.pop();
+            NodeType *current = nodes.front();
+            nodes.pop_front();
 
             for (const auto &child : current->get_children()) {
                 if (child != nullptr) {
@@ -382,12 +985,25 @@ public:
         return BFSIterator(root);
     }
 
+    /**
+     * Get an iterator to the beginning of the BFS traversal that keeps its queue in a caller buffer
+     * 
+     * The buffer is only used when the inline queue of the iterator is too small, and it can be
+     * reused between traversals, so after the first traversal there are no heap allocations at all.
+     * 
+     * @param scratch The buffer for the iterator queue
+     * @return BFS iterator pointing to the root node
+     */
+    BFSIterator begin_bfs_scan(vector<NodeType *> &scratch) const {
+        return BFSIterator(root, &scratch);
+    }
+
     /**
      * Get an iterator to the end of the BFS traversal
-     * @return BFS iterator pointing to the end - nullptr
+     * @return The end of the BFS traversal (compares equal to a finished iterator)
      */
-    BFSIterator end_bfs_scan() const {
-        return BFSIterator(nullptr);
+    TraversalEnd end_bfs_scan() const {
+        return TraversalEnd();
     }
 
     /** 
@@ -396,10 +1012,10 @@ public:
      */
     class DFSIterator {
     private:
-        stack<Node<T> *> nodes;
+        TraversalBuffer<NodeType *> nodes;
 
     public:
-        explicit DFSIterator(Node<T> *node) {
+        explicit DFSIterator(NodeType *node, vector<NodeType *> *scratch = nullptr) : nodes(scratch) {
             if (node) { 
                 nodes.push(node);
             }
@@ -409,17 +1025,25 @@ public:
             return !nodes.empty() != !other.nodes.empty();
         }
 
-        Node<T> *operator->() const {
-            return nodes.top();
+        bool operator!=(const TraversalEnd &) const {
+            return !nodes.empty();
+        }
+
+        bool operator==(const TraversalEnd &) const {
+            return nodes.empty();
         }
 
-        Node<T> &operator*() const {
-            return *nodes.top();
+        NodeType *operator->() const {
+            return nodes.back();
+        }
+
+        NodeType &operator*() const {
+            return *nodes.back();
         }
 
         DFSIterator &operator++() {
-            const auto &children = nodes.top()->get_children();
-            nodes.pop();
+            const auto &children = nodes.back()->get_children();
+            nodes.pop_back();
 
             for (auto child = children.rbegin(); child != children.rend(); ++child) {
                 if (*child != nullptr) {
@@ -439,12 +1063,25 @@ public:
         return DFSIterator(root);
     }
 
+    /**
+     * Get an iterator to the beginning of the DFS traversal that keeps its stack in a caller buffer
+     * 
+     * The buffer is only used when the inline stack of the iterator is too small, and it can be
+     * reused between traversals, so after the first traversal there are no heap allocations at all.
+     * 
+     * @param scratch The buffer for the iterator stack
+     * @return DFS iterator pointing to the root node
+     */
+    DFSIterator begin_dfs_scan(vector<NodeType *> &scratch) const {
+        return DFSIterator(root, &scratch);
+    }
+
     /**
      * Get an iterator to the end of the DFS traversal
-     * @return DFS iterator pointing to the end - nullptr
+     * @return The end of the DFS traversal (compares equal to a finished iterator)
      */
-    DFSIterator end_dfs_scan() const {
-        return DFSIterator(nullptr);
+    TraversalEnd end_dfs_scan() const {
+        return TraversalEnd();
     }
     /**
      * Get an iterator for BFS traversal 
@@ -455,102 +1092,429 @@ public:
     }
 
     /**
-     * Get an iterator for BFS traversal
-     * @return BFS iterator pointing to the end - nullptr
+     * Get the end of the BFS traversal
+     * @return The end of the BFS traversal (compares equal to a finished iterator)
+     */
+    TraversalEnd end() const {
+        return TraversalEnd();
+    }
+
+    /**
+     * Call a function on every node in pre-order (root, children)
+     * 
+     * Faster than the pre-order iterator, since the whole traversal is one loop that the function can be inlined into,
+     * and the children start loading into the cache as soon as they are pushed.
+     * 
+     * @param visit The function to call, with a NodeType& argument
+     */
+    template <typename F>
+    void for_each_pre_order(F &&visit) const {
+        if (!root) { return; }
+
+        TraversalBuffer<NodeType *> nodes;
+        nodes.push(root);
+
+        while (!nodes.empty()) {
+            NodeType *node = nodes.back();
+            nodes.pop_back();
+            visit(*node);
+
+            const auto &children = node->get_children();
+            for (auto child = children.rbegin(); child != children.rend(); ++child) {
+                if (*child != nullptr) {
+                    TREE_PREFETCH(*child);
+                    nodes.push(*child);
+                }
+            }
+        }
+    }
+
+    /**
+     * Call a function on every node in post-order (children, root)
+     * 
+     * Each stack frame keeps the index of the next child to visit, so every step takes O(1).
+     * 
+     * @param visit The function to call, with a NodeType& argument
+     */
+    template <typename F>
+    void for_each_post_order(F &&visit) const {
+        if (!root) { return; }
+
+        TraversalBuffer<PostOrderFrame> frames;
+        frames.push(PostOrderFrame(root, 0));
+
+        while (!frames.empty()) {
+            auto &frame = frames.back();
+            const auto &children = frame.first->get_children();
+
+            // Skip missing children
+            while (frame.second < children.size() && children[frame.second] == nullptr) {
+                ++frame.second;
+            }
+
+            if (frame.second < children.size()) {
+                NodeType *child = children[frame.second++];
+                frames.push(PostOrderFrame(child, 0));
+            } else {
+                NodeType *node = frame.first;
+                frames.pop_back();
+                visit(*node);
+            }
+        }
+    }
+
+    /**
+     * Call a function on every node in in-order (left, root, right) for binary trees,
+     * and in pre-order for other trees, like the in-order iterator
+     * 
+     * @param visit The function to call, with a NodeType& argument
      */
-    BFSIterator end() const {
-        return BFSIterator(nullptr);
+    template <typename F>
+    void for_each_in_order(F &&visit) const {
+        if (max_children() != 2) {
+            for_each_pre_order(visit);
+            return;
+        }
+
+        TraversalBuffer<NodeType *> nodes;
+        NodeType *node = root;
+
+        while (node != nullptr || !nodes.empty()) {
+            // Go down the left branch, and start loading the right children on the way
+            while (node != nullptr) {
+                nodes.push(node);
+                const auto &children = node->get_children();
+
+                if (children.size() > 1 && children[1] != nullptr) {
+                    TREE_PREFETCH(children[1]);
+                }
+
+                node = children.empty() ? nullptr : children[0];
+            }
+
+            node = nodes.back();
+            nodes.pop_back();
+            visit(*node);
+
+            const auto &children = node->get_children();
+            node = children.size() > 1 ? children[1] : nullptr;
+        }
+    }
+
+    /**
+     * Call a function on every node in BFS order (level by level)
+     * 
+     * @param visit The function to call, with a NodeType& argument
+     */
+    template <typename F>
+    void for_each_bfs(F &&visit) const {
+        if (!root) { return; }
+
+        TraversalBuffer<NodeType *> nodes;
+        nodes.push(root);
+
+        while (!nodes.empty()) {
+            NodeType *node = nodes.front();
+            nodes.pop_front();
+            visit(*node);
+
+            for (auto child : node->get_children()) {
+                if (child != nullptr)
+                    nodes.push(child);
+            }
+        }
+    }
+
+    /**
+     * A unique id for each order type, to remember which order the tree is heap-ordered by
+     * 
+     * Two orders of the same type are only the same order when the type has no state (see is_stateless_order),
+     * the other types have no id, so a tree heap-ordered by them is never taken as heap-ordered.
+     * 
+     * @tparam Compare The order type
+     * @return The id of the order type, nullptr if the type can hold different orders
+     */
+    template <typename Compare>
+    static const void *order_id() {
+        static const char id = 0;
+        return is_stateless_order<Compare>::value ? &id : nullptr;
     }
 
     /** 
      * Heap iterator class
-     * Provides an iterator for traversing the tree in a heap order
+     * Provides an iterator for traversing the tree in a heap order (smallest value first, or first in a given order)
+     * 
+     * When the tree is heap-ordered (after myHeap with the same order), the first value not visited yet is always a child
+     * of a visited node, so the iterator only keeps that frontier in a priority queue, starting from the root.
+     * Getting the first k values then costs O(k log k), and nothing is done before the first one.
+     * Otherwise the nodes are gathered once in O(N) and every step pops the next one in O(log N).
+     * 
+     * @tparam Compare The order, like in std::sort
      */
+    template <typename Compare = SmallerFirst>
     class HeapIterator {
     private:
-        vector<Node<T> *> nodes; // Vector to store heap nodes
-        size_t maxChildren;      // Maximum number of children to each node
+        vector<NodeType *> nodes; // The heap of the next nodes (the frontier when the tree is heap-ordered)
+        bool frontier;            // true if only the frontier of a heap-ordered tree is kept
+        Compare compare;          // The order of the values
 
-        bool compare_two_nodes(Node<T> *a, Node<T> *b) const {
-            return a->get_value() > b->get_value(); 
-        }
+        // The std heap functions keep the biggest in front, so the node that comes first in the order is the "biggest"
+        struct NodeOrder {
+            const Compare &compare;
 
-        // An helper recursive function to traverse the tree and store nodes
-        void traverse_and_store(Node<T> *node) {
-            if (node) {
+            bool operator()(NodeType *a, NodeType *b) const {
+                return compare(b->get_value(), a->get_value());
+            }
+        };
+
+    public:
+        /**
+         * Constructor that starts the heap order from the root
+         * 
+         * @param root The root of the tree, or nullptr
+         * @param heapOrdered true if no node of the tree comes after its children in the order
+         * @param compare The order of the values
+         */
+        HeapIterator(NodeType *root, bool heapOrdered, Compare compare = Compare()) : frontier(heapOrdered), compare(compare) {
+            if (!root) { return; }
+
+            if (frontier) {
+                nodes.push_back(root);
+                return;
+            }
+
+            // Get all the nodes, without recursion
+            vector<NodeType *> stack{root};
+            while (!stack.empty()) {
+                NodeType *node = stack.back();
+                stack.pop_back();
                 nodes.push_back(node);
 
                 for (auto child : node->get_children()) {
-                    traverse_and_store(child); 
+                    if (child)
+                        stack.push_back(child);
                 }
             }
-        }
-
-    public:
-        // Constructor that initializes heap and stores nodes
-        HeapIterator(Node<T> *root, size_t maxChildren) : maxChildren(maxChildren) {
-            traverse_and_store(root); // Get all nodes starting from the root
 
-            auto compare = [this](Node<T>* a, Node<T>* b) {
-                return compare_two_nodes(a, b);
-            };
-
-            // Build the heap using the regular comparison function
-            make_heap(nodes.begin(), nodes.end(), compare);
+            make_heap(nodes.begin(), nodes.end(), NodeOrder{this->compare});
         }
 
         bool operator!=(const HeapIterator &other) const {
             return !nodes.empty() != !other.nodes.empty();
         }
 
-        Node<T> *operator->() const {
+        bool operator!=(const TraversalEnd &) const {
+            return !nodes.empty();
+        }
+
+        bool operator==(const TraversalEnd &) const {
+            return nodes.empty();
+        }
+
+        NodeType *operator->() const {
             return nodes.front();
         }
 
-        Node<T> &operator*() const {
+        NodeType &operator*() const {
             return *nodes.front();
         }
 
         HeapIterator &operator++() {
-            auto compare = [this](Node<T>* a, Node<T>* b) {
-                return compare_two_nodes(a, b);
-            };
-
-            pop_heap(nodes.begin(), nodes.end(), compare);
+            NodeType *current = nodes.front();
+            pop_heap(nodes.begin(), nodes.end(), NodeOrder{compare});
             nodes.pop_back();
+
+            // The children of the visited node are the only new candidates
+            if (frontier) {
+                for (auto child : current->get_children()) {
+                    if (child) {
+                        nodes.push_back(child);
+                        push_heap(nodes.begin(), nodes.end(), NodeOrder{compare});
+                    }
+                }
+            }
+
             return *this;
         }
     };
 
+    /**
+     * Get an iterator to the beginning of the heap order (smallest value first by default)
+     * 
+     * It is lazy when the tree is heap-ordered by the same order (see is_heap_ordered), and otherwise gathers all the nodes first.
+     * 
+     * @param compare The order, like in std::sort - SmallerFirst by default
+     * @return Heap iterator pointing to the node with the first value in the order
+     */
+    template <typename Compare = SmallerFirst>
+    HeapIterator<Compare> begin_heap(Compare compare = Compare()) const {
+        return HeapIterator<Compare>(root, is_heap_ordered(compare), compare);
+    }
+
+    /**
+     * Get an iterator to the end of the heap order
+     * @return The end of the heap order (compares equal to a finished iterator)
+     */
+    TraversalEnd end_heap() const {
+        return TraversalEnd();
+    }
+
+    /**
+     * Check if the tree is heap-ordered by a given order, which makes the heap iterator lazy
+     * 
+     * Changing values with Node::swap_value directly is not tracked.
+     * 
+     * @param compare The order - SmallerFirst (a min-heap) by default
+     * @return true if myHeap() converted the whole tree with this order and it did not change since,
+     *         always false for orders with state (like function pointers)
+     */
+    template <typename Compare = SmallerFirst>
+    bool is_heap_ordered(const Compare & = Compare()) const {
+        return root && heapOrder && heapOrder == order_id<Compare>();
+    }
+
+    /**
+     * Get the first k values of the tree in a given order (the k smallest by default)
+     * 
+     * For a small k the values stream through a bounded heap of k values in one pass, so there is no copy of the whole tree.
+     * For a bigger k the values are gathered and selected with nth_element, in O(N + k log k).
+     * 
+     * @param k The number of values
+     * @param compare The order, like in std::sort - SmallerFirst by default, use a bigger-first one for the k largest
+     * @return The first k values in order (all of them if the tree has fewer)
+     */
+    template <typename Compare = SmallerFirst>
+    vector<T> top_k(size_t k, Compare compare = Compare()) const {
+        vector<T> values;
+        if (k == 0) { return values; }
+
+        if (k <= TOP_K_HEAP_LIMIT) {
+            // The heap front is the last of the k values so far, and a new value only goes in if it comes before it
+            values.reserve(k);
+            for_each_pre_order([&](const NodeType &node) {
+                const T &value = node.get_value();
+
+                if (values.size() < k) {
+                    values.push_back(value);
+                    push_heap(values.begin(), values.end(), compare);
+                } else if (compare(value, values.front())) {
+                    pop_heap(values.begin(), values.end(), compare);
+                    values.back() = value;
+                    push_heap(values.begin(), values.end(), compare);
+                }
+            });
+
+            sort_heap(values.begin(), values.end(), compare);
+            return values;
+        }
+
+        for_each_pre_order([&](const NodeType &node) { values.push_back(node.get_value()); });
+
+        if (k < values.size()) {
+            nth_element(values.begin(), values.begin() + k, values.end(), compare);
+            values.erase(values.begin() + k, values.end());
+        }
+
+        sort(values.begin(), values.end(), compare);
+        return values;
+    }
+
+    /**
+     * Get the value at a given position of the tree values in a given order, with introselect (nth_element) in O(N)
+     * 
+     * @param k The position, 0 for the first (smallest by default) value
+     * @param compare The order, like in std::sort - SmallerFirst by default
+     * @return The k-th value
+     * 
+     * @throws runtime_error if the tree has no more than k values
+     */
+    template <typename Compare = SmallerFirst>
+    T kth(size_t k, Compare compare = Compare()) const {
+        vector<T> values;
+        for_each_pre_order([&](const NodeType &node) { values.push_back(node.get_value()); });
+
+        if (k >= values.size()) {
+            throw runtime_error("############ Error: There are not enough values in the tree... ############");
+        }
+
+        nth_element(values.begin(), values.begin() + k, values.end(), compare);
+        return values[k];
+    }
+
+    /**
+     * Move the value of a node down until it does not come after any of its children in a given order,
+     * when the subtrees of its children are already heaps
+     * 
+     * @param node The node to start from
+     * @param compare The order of the values
+     */
+    template <typename Compare>
+    static void sift_down(NodeType *node, const Compare &compare) {
+        while (true) {
+            NodeType *first = node;
+
+            for (auto child : node->get_children()) {
+                if (child && compare(child->get_value(), first->get_value())) {
+                    first = child;
+                }
+            }
+
+            if (first == node) { return; }
+
+            node->swap_value(*first);
+            node = first;
+        }
+    }
+
     /** 
-     * Convert binary tree to min-heap
-     * This function changes the nodes to satisfy the min-heap property
-     * @param node The starting node of the tree to be converted
+     * Convert a subtree to a heap, where every node's value does not come after its children's values in a given order
+     * (a min-heap by default, BiggerFirst gives a max-heap)
+     * 
+     * Works bottom-up like Floyd's heap construction: every node is sifted down after its children's subtrees
+     * are heaps. That takes O(N) for balanced trees (O(sum of the subtree heights) in general).
+     * Only the values move, the tree shape stays the same.
+     * 
+     * Sifting a node down only touches its own subtree, so with more than one thread
+     * the independent subtrees are done in parallel (see parallel_for_each).
+     * 
+     * @param node The root of the subtree to convert
+     * @param threads The number of threads to use
+     * @param compare The order, like in std::sort - SmallerFirst by default
      */
-    void myHeap(Node<T> *node) {
+    template <typename Compare = SmallerFirst>
+    void myHeap(NodeType *node, size_t threads = 1, Compare compare = Compare()) {
         if (!node) { 
             return;
         }
 
-        auto children = node->get_children();
+        auto sift = [&compare](NodeType &current) { sift_down(&current, compare); };
+        ParallelTraversal<NodeType, decltype(sift)> traversal(sift, ParallelOrder::post_order, threads);
+        traversal.run(node);
+        ++version;
 
-        // Make sure all children are heaps and adjust the current node in recursive way
-        for (auto* child : children) {
-            myHeap(child);
+        if (node == root) {
+            heapOrder = order_id<Compare>();
+        } else if (heapOrder != order_id<Compare>()) {
+            heapOrder = nullptr;
         }
 
-        // Change the current node to maintain heap property
-        for (auto* child : children) {
-            if (child && node->get_value() > child->get_value()) {
-                swap(node->get_value(), child->get_value());
-            }
+        // The values moved, so the index has to be built again
+        if (indexed) {
+            index.clear();
+            index_subtree(root);
         }
+        notify_change();
     }
 
-    
-    // Convert the entire tree to a min-heap
-    void myHeap() {
-        myHeap(root);
+    /**
+     * Convert the entire tree to a heap (a min-heap by default)
+     * 
+     * @param threads The number of threads to use
+     * @param compare The order, like in std::sort - SmallerFirst by default
+     */
+    template <typename Compare = SmallerFirst>
+    void myHeap(size_t threads = 1, Compare compare = Compare()) {
+        myHeap(root, threads, compare);
     }
 };
 
@@ -0,0 +1,325 @@
+// noavrd@gmail.com
+
+#ifndef TREE_CSV_HPP
+#define TREE_CSV_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <istream>
+#include <cstdint>
+#include <cstring>
+#include <charconv>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+
+#include "complex.hpp"
+
+using namespace std;
+
+// The size of the chunks the CSV loader reads at a time
+constexpr size_t CSV_CHUNK_SIZE = 1 << 20;
+
+/**
+ * Parse a number field of a CSV line
+ *
+ * @param first The first character of the field
+ * @param last The end of the field
+ * @param value The parsed number
+ * @return true if the whole field is a number
+ */
+template <typename N>
+bool parse_csv_number(const char *first, const char *last, N &value) {
+    auto result = from_chars(first, last, value);
+    return result.ec == errc() && result.ptr == last;
+}
+
+/**
+ * Parse the value fields of a CSV line (everything after the child id)
+ *
+ * Numbers are one field, a Complex is two fields (real,imag) and a string is the rest of the line as is.
+ *
+ * @param first The first character of the value fields
+ * @param last The end of the line
+ * @param value The parsed value
+ * @return true if the fields are a valid value
+ */
+template <typename T>
+bool parse_csv_value(const char *first, const char *last, T &value) {
+    static_assert(is_arithmetic<T>::value, "CSV values can be numbers, strings or Complex");
+    return parse_csv_number(first, last, value);
+}
+
+inline bool parse_csv_value(const char *first, const char *last, string &value) {
+    value.assign(first, last);
+    return true;
+}
+
+inline bool parse_csv_value(const char *first, const char *last, Complex &value) {
+    const char *comma = static_cast<const char *>(memchr(first, ',', last - first));
+    double real, imag;
+
+    if (!comma || !parse_csv_number(first, comma, real) || !parse_csv_number(comma + 1, last, imag)) {
+        return false;
+    }
+
+    value = Complex(real, imag);
+    return true;
+}
+
+/**
+ * TreeCsvLoader class template
+ *
+ * Builds a tree from an edge list in CSV text, one "parent_id,child_id,value" line per node, read in chunks.
+ * The ids are non-negative integers, and the root has an empty parent id (or -1).
+ * A header line and empty lines are skipped.
+ *
+ * Every node is found by its id in an array (for ids up to a few times the number of nodes) or a hash map,
+ * never by searching the tree, and the text is never kept after its line is parsed,
+ * so the memory is the tree plus one chunk.
+ * A child may come before its parent - it waits (with its own subtree) until the parent's line arrives.
+ *
+ * @tparam TreeType The tree type
+ */
+template <typename TreeType>
+class TreeCsvLoader {
+public:
+    using NodeType = typename TreeType::NodeType;
+    using ValueType = typename remove_cv<typename remove_reference<decltype(declval<NodeType>().get_value())>::type>::type;
+
+private:
+    TreeType &tree;
+    vector<NodeType *> denseNodes;                       // The nodes with small ids, by id (nullptr for unused ids)
+    unordered_map<uint64_t, NodeType *> sparseNodes;     // The nodes with big ids, by id
+    size_t nodeCount;                                    // The number of nodes
+    unordered_map<uint64_t, vector<NodeType *>> waiting; // Children whose parent did not come yet, by the parent id
+    NodeType *root;
+    size_t lineNumber;
+    bool hadWaiting; // true if a child ever came before its parent, which can hide a cycle
+
+    [[noreturn]] void fail(const string &problem) const {
+        throw runtime_error("############ Error: Line " + to_string(lineNumber) + " of the tree CSV: " + problem + "... ############");
+    }
+
+    // Ids up to a few times the number of nodes are kept in the vector, so dense ids need no hashing
+    bool is_dense(uint64_t id) const {
+        return id < 4 * nodeCount + 1024;
+    }
+
+    NodeType *find_node(uint64_t id) const {
+        if (id < denseNodes.size() && denseNodes[id]) {
+            return denseNodes[id];
+        }
+
+        // An id can be sparse when it comes, and below the size of the vector once it grows
+        if (sparseNodes.empty()) {
+            return nullptr;
+        }
+
+        auto it = sparseNodes.find(id);
+        return it == sparseNodes.end() ? nullptr : it->second;
+    }
+
+    void add_node(uint64_t id, NodeType *node) {
+        if (is_dense(id)) {
+            if (id >= denseNodes.size()) {
+                denseNodes.resize(max<size_t>(id + 1, denseNodes.size() * 2), nullptr);
+            }
+            denseNodes[id] = node;
+        } else {
+            sparseNodes.emplace(id, node);
+        }
+        ++nodeCount;
+    }
+
+    void add_child(NodeType *parent, NodeType *child) {
+        if (parent->get_children().size() >= tree.max_children()) {
+            fail("too much children");
+        }
+        parent->add_sub_node(child, tree.max_children());
+    }
+
+    void parse_line(const char *first, const char *last) {
+        ++lineNumber;
+
+        if (last > first && last[-1] == '\r') {
+            --last;
+        }
+        if (first == last) {
+            return;
+        }
+
+        const char *comma1 = static_cast<const char *>(memchr(first, ',', last - first));
+        const char *comma2 = comma1 ? static_cast<const char *>(memchr(comma1 + 1, ',', last - comma1 - 1)) : nullptr;
+        if (!comma2) {
+            fail("expected parent_id,child_id,value");
+        }
+
+        bool isRoot = comma1 == first || (comma1 - first == 2 && first[0] == '-' && first[1] == '1');
+        uint64_t parentId = 0, childId = 0;
+
+        if ((!isRoot && !parse_csv_number(first, comma1, parentId)) || !parse_csv_number(comma1 + 1, comma2, childId)) {
+            // The first line can be a header
+            if (lineNumber == 1) {
+                return;
+            }
+            fail("bad node id");
+        }
+
+        ValueType value{};
+        if (!parse_csv_value(comma2 + 1, last, value)) {
+            fail("bad value");
+        }
+
+        if (find_node(childId)) {
+            fail("the node id is used twice");
+        }
+
+        NodeType *child = &tree.create_node(value);
+        add_node(childId, child);
+
+        // Children that came before this node
+        auto early = waiting.find(childId);
+        if (early != waiting.end()) {
+            for (NodeType *grandchild : early->second) {
+                add_child(child, grandchild);
+            }
+            waiting.erase(early);
+        }
+
+        if (isRoot) {
+            if (root) {
+                fail("there is more than one root");
+            }
+            root = child;
+            return;
+        }
+
+        if (NodeType *parent = find_node(parentId)) {
+            add_child(parent, child);
+        } else {
+            waiting[parentId].push_back(child);
+            hadWaiting = true;
+        }
+    }
+
+    // Count the nodes of a subtree
+    static size_t count_subtree(NodeType *node) {
+        size_t count = 0;
+        vector<NodeType *> stack{node};
+
+        while (!stack.empty()) {
+            NodeType *current = stack.back();
+            stack.pop_back();
+            ++count;
+
+            for (auto child : current->get_children()) {
+                stack.push_back(child);
+            }
+        }
+
+        return count;
+    }
+
+    // Parse all the lines and check that they make one tree
+    void read_lines(istream &in, size_t chunkSize) {
+        vector<char> buffer(max<size_t>(chunkSize, 1));
+        size_t kept = 0; // The start of a line that did not end in the last chunk
+
+        while (in) {
+            // A line longer than a chunk makes the buffer bigger
+            if (kept == buffer.size()) {
+                buffer.resize(buffer.size() * 2);
+            }
+
+            in.read(buffer.data() + kept, static_cast<streamsize>(buffer.size() - kept));
+            size_t end = kept + static_cast<size_t>(in.gcount());
+
+            const char *line = buffer.data();
+            const char *stop = buffer.data() + end;
+            while (const char *newline = static_cast<const char *>(memchr(line, '\n', stop - line))) {
+                parse_line(line, newline);
+                line = newline + 1;
+            }
+
+            kept = stop - line;
+            memmove(buffer.data(), line, kept);
+        }
+
+        // The last line, when the text does not end with a newline
+        parse_line(buffer.data(), buffer.data() + kept);
+
+        if (!waiting.empty()) {
+            fail("a node has a parent id that is not in the file");
+        }
+        if (!root) {
+            fail("there is no root");
+        }
+
+        // Nodes that are each other's ancestors are not under the root
+        if (hadWaiting && count_subtree(root) != nodeCount) {
+            fail("some nodes are their own ancestors");
+        }
+    }
+
+public:
+    explicit TreeCsvLoader(TreeType &tree) : tree(tree), nodeCount(0), root(nullptr), lineNumber(0), hadWaiting(false) {}
+
+    /**
+     * Read all the lines of a stream and set the root of the tree
+     *
+     * @param in The CSV text
+     * @param chunkSize The number of bytes to read at a time
+     *
+     * @throws runtime_error on a bad line, a node with too many children, no root or more than one,
+     *         or a node whose parent never came; the nodes it created are freed and the tree is not changed
+     */
+    void load(istream &in, size_t chunkSize = CSV_CHUNK_SIZE) {
+        size_t ownedBefore = tree.owned_nodes();
+
+        try {
+            read_lines(in, chunkSize);
+        } catch (...) {
+            tree.release_nodes_after(ownedBefore);
+            throw;
+        }
+
+        tree.add_root(*root);
+    }
+};
+
+/**
+ * Build a tree from CSV text, see TreeCsvLoader
+ *
+ * @param tree The tree to build, its nodes are created with create_node
+ * @param in The CSV text
+ * @param chunkSize The number of bytes to read at a time
+ *
+ * @throws runtime_error like TreeCsvLoader::load
+ */
+template <typename TreeType>
+void load_tree_csv(TreeType &tree, istream &in, size_t chunkSize = CSV_CHUNK_SIZE) {
+    TreeCsvLoader<TreeType>(tree).load(in, chunkSize);
+}
+
+/**
+ * Build a tree from a CSV file, see TreeCsvLoader
+ *
+ * @param tree The tree to build, its nodes are created with create_node
+ * @param path The file path
+ *
+ * @throws runtime_error if the file can't be opened, or like TreeCsvLoader::load
+ */
+template <typename TreeType>
+void load_tree_csv(TreeType &tree, const string &path) {
+    ifstream in(path, ios::binary);
+    if (!in) {
+        throw runtime_error("############ Error: Can't open the tree CSV file... ############");
+    }
+
+    load_tree_csv(tree, in);
+}
+
+#endif // TREE_CSV_HPP
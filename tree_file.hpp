@@ -0,0 +1,503 @@
+// noavrd@gmail.com
+
+#ifndef TREE_FILE_HPP
+#define TREE_FILE_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "frozen_tree.hpp"
+
+using namespace std;
+
+/**
+ * The header at the start of a tree file
+ *
+ * The file is the FrozenTree layout as is: the values and the structure arrays in pre-order, every section
+ * starting at a multiple of 64 bytes, so a mapped file can be read in place with no parsing and no allocation.
+ * Numbers are in the byte order of the machine that saved the file (checked on load).
+ */
+struct TreeFileHeader {
+    char magic[8];               // "CPPTREE\0"
+    uint32_t version;            // TREE_FILE_VERSION
+    uint32_t byteOrder;          // TREE_FILE_BYTE_ORDER as written by the saving machine
+    uint32_t valueKind;          // TREE_FILE_RAW_VALUES or TREE_FILE_STRING_VALUES
+    uint32_t valueSize;          // sizeof(T) for raw values
+    uint64_t arity;              // The maximum number of children of the saved tree
+    uint64_t nodeCount;          // The number of nodes
+    uint64_t valuesOffset;       // The raw values, or the string offset table (nodeCount + 1 offsets into the blob)
+    uint64_t blobOffset;         // The string bytes (strings only)
+    uint64_t blobSize;           // The number of string bytes (strings only)
+    uint64_t parentsOffset;      // The parent index of each node (uint32, FrozenTree::NO_NODE for the root)
+    uint64_t subtreeSizesOffset; // The subtree size of each node (uint32)
+    uint64_t childCountsOffset;  // The number of children of each node (uint32)
+    uint64_t fileSize;           // The size of the whole file
+};
+
+constexpr char TREE_FILE_MAGIC[8] = {'C', 'P', 'P', 'T', 'R', 'E', 'E', '\0'};
+constexpr uint32_t TREE_FILE_VERSION = 1;
+constexpr uint32_t TREE_FILE_BYTE_ORDER = 0x01020304;
+constexpr uint32_t TREE_FILE_RAW_VALUES = 0;
+constexpr uint32_t TREE_FILE_STRING_VALUES = 1;
+constexpr uint64_t TREE_FILE_ALIGNMENT = 64;
+
+/**
+ * A read-only memory mapping of a whole file, unmapped when it is destroyed
+ */
+class MappedFile {
+private:
+    const char *data; // The mapped bytes, nullptr for an empty mapping
+    size_t length;    // The number of mapped bytes
+
+public:
+    /**
+     * Map a file
+     *
+     * @param path The file path
+     *
+     * @throws runtime_error if the file can't be opened or mapped
+     */
+    explicit MappedFile(const string &path) : data(nullptr), length(0) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw runtime_error("############ Error: Can't open the tree file... ############");
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            throw runtime_error("############ Error: Can't read the tree file... ############");
+        }
+
+        length = static_cast<size_t>(info.st_size);
+        if (length > 0) {
+            void *memory = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (memory == MAP_FAILED) {
+                close(fd);
+                throw runtime_error("############ Error: Can't map the tree file... ############");
+            }
+            data = static_cast<const char *>(memory);
+        }
+
+        // The mapping stays valid after the file is closed
+        close(fd);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other) noexcept : data(other.data), length(other.length) {
+        other.data = nullptr;
+        other.length = 0;
+    }
+
+    MappedFile &operator=(MappedFile &&other) noexcept {
+        if (this != &other) {
+            unmap();
+            data = other.data;
+            length = other.length;
+            other.data = nullptr;
+            other.length = 0;
+        }
+        return *this;
+    }
+
+    ~MappedFile() {
+        unmap();
+    }
+
+    void unmap() {
+        if (data) {
+            munmap(const_cast<char *>(data), length);
+            data = nullptr;
+            length = 0;
+        }
+    }
+
+    const char *bytes() const { return data; }
+    size_t size() const { return length; }
+};
+
+/**
+ * MappedTree class template
+ *
+ * A read-only tree over a mapped tree file, made by Tree::load_mmap().
+ * Opening it only checks the header and that every section is inside the file, so it costs the same for any size
+ * and no page of the arrays is read. The accessors check the node index (and the offsets of a string), so a damaged
+ * file can give wrong answers or errors but never reads out of the mapping. verify() checks the whole structure
+ * in one pass, for files that are not trusted. The values are read straight from the mapping,
+ * so their pages are loaded by the OS when they are first used.
+ *
+ * It has the same node index accessors as FrozenTree (nodes are numbered in pre-order).
+ * String values are read as string_views into the file.
+ *
+ * @tparam T The type of the values in the tree, trivially copyable or std::string
+ */
+template <typename T>
+class MappedTree {
+public:
+    static constexpr bool STRING_VALUES = is_same<T, string>::value;
+    static_assert(STRING_VALUES || is_trivially_copyable<T>::value, "Tree files hold trivially copyable values or strings");
+
+    // How a value is read: a reference into the file, or a string_view for strings
+    using value_reference = typename conditional<STRING_VALUES, string_view, const T &>::type;
+
+    static constexpr uint32_t NO_NODE = FrozenTree<T>::NO_NODE;
+
+    /**
+     * Iterator over the values in pre-order
+     */
+    class Iterator {
+    private:
+        const MappedTree *tree;
+        uint32_t node;
+
+    public:
+        using iterator_category = forward_iterator_tag;
+        using value_type = typename conditional<STRING_VALUES, string_view, T>::type;
+        using difference_type = ptrdiff_t;
+        using pointer = void;
+        using reference = value_reference;
+
+        Iterator(const MappedTree *tree, uint32_t node) : tree(tree), node(node) {}
+
+        bool operator!=(const Iterator &other) const { return node != other.node; }
+        bool operator==(const Iterator &other) const { return node == other.node; }
+
+        value_reference operator*() const { return tree->value(node); }
+
+        // The index of the current node
+        uint32_t index() const { return node; }
+
+        Iterator &operator++() {
+            ++node;
+            return *this;
+        }
+    };
+
+private:
+    MappedFile file;
+    TreeFileHeader header;
+    const T *values;              // Raw values (not for strings)
+    const uint64_t *stringStarts; // String offsets into the blob (strings only)
+    const char *blob;             // String bytes (strings only)
+    const uint32_t *parents;
+    const uint32_t *subtreeSizes;
+    const uint32_t *childCounts;
+
+    [[noreturn]] static void damaged() {
+        throw runtime_error("############ Error: The tree file is damaged... ############");
+    }
+
+    // Check that a section of count items of a given size is inside the file
+    void check_section(uint64_t offset, uint64_t count, uint64_t itemSize) const {
+        if (offset % TREE_FILE_ALIGNMENT != 0 || offset > file.size() || count > (file.size() - offset) / itemSize) {
+            damaged();
+        }
+    }
+
+    void check_node(uint32_t i) const {
+        if (i >= header.nodeCount) {
+            throw runtime_error("############ Error: The node index is not in the tree... ############");
+        }
+    }
+
+public:
+    /**
+     * Map a tree file
+     *
+     * @param path The file path
+     * @param verifyStructure true to check the whole structure with verify(), which reads all the arrays
+     *
+     * @throws runtime_error if the file can't be mapped, is not a tree file of this value type or is damaged
+     */
+    explicit MappedTree(const string &path, bool verifyStructure = false)
+        : file(path), values(nullptr), stringStarts(nullptr), blob(nullptr), parents(nullptr), subtreeSizes(nullptr), childCounts(nullptr) {
+        if (file.size() < sizeof(TreeFileHeader)) {
+            throw runtime_error("############ Error: The file is not a tree file... ############");
+        }
+
+        memcpy(&header, file.bytes(), sizeof(TreeFileHeader));
+
+        if (memcmp(header.magic, TREE_FILE_MAGIC, sizeof(TREE_FILE_MAGIC)) != 0 || header.version != TREE_FILE_VERSION ||
+            header.byteOrder != TREE_FILE_BYTE_ORDER) {
+            throw runtime_error("############ Error: The file is not a tree file... ############");
+        }
+
+        if (header.valueKind != (STRING_VALUES ? TREE_FILE_STRING_VALUES : TREE_FILE_RAW_VALUES) ||
+            (!STRING_VALUES && header.valueSize != sizeof(T))) {
+            throw runtime_error("############ Error: The tree file has another value type... ############");
+        }
+
+        if (header.fileSize != file.size() || header.nodeCount >= NO_NODE) {
+            damaged();
+        }
+
+        uint64_t count = header.nodeCount;
+        const char *bytes = file.bytes();
+
+        if constexpr (STRING_VALUES) {
+            check_section(header.valuesOffset, count + 1, sizeof(uint64_t));
+            check_section(header.blobOffset, header.blobSize, 1);
+            stringStarts = reinterpret_cast<const uint64_t *>(bytes + header.valuesOffset);
+            blob = bytes + header.blobOffset;
+        } else {
+            check_section(header.valuesOffset, count, sizeof(T));
+            values = reinterpret_cast<const T *>(bytes + header.valuesOffset);
+        }
+
+        check_section(header.parentsOffset, count, sizeof(uint32_t));
+        check_section(header.subtreeSizesOffset, count, sizeof(uint32_t));
+        check_section(header.childCountsOffset, count, sizeof(uint32_t));
+
+        parents = reinterpret_cast<const uint32_t *>(bytes + header.parentsOffset);
+        subtreeSizes = reinterpret_cast<const uint32_t *>(bytes + header.subtreeSizesOffset);
+        childCounts = reinterpret_cast<const uint32_t *>(bytes + header.childCountsOffset);
+
+        if (verifyStructure) {
+            verify();
+        }
+    }
+
+    /**
+     * Check the whole file in one pass: the string offsets grow and end at the end of the blob,
+     * and the arrays are a tree in pre-order - every node is inside the subtree of its parent,
+     * and has as many children as there are nodes naming it as their parent (and no more than the arity)
+     *
+     * It reads all the arrays and allocates one counter per node.
+     *
+     * @throws runtime_error if the file is damaged
+     */
+    void verify() const {
+        uint32_t count = static_cast<uint32_t>(header.nodeCount);
+
+        if constexpr (STRING_VALUES) {
+            if (stringStarts[0] != 0 || stringStarts[count] != header.blobSize) {
+                damaged();
+            }
+            for (uint32_t i = 0; i < count; ++i) {
+                if (stringStarts[i + 1] < stringStarts[i]) {
+                    damaged();
+                }
+            }
+        }
+
+        if (count == 0) {
+            return;
+        }
+
+        bool valid = parents[0] == NO_NODE && subtreeSizes[0] == count;
+        vector<uint32_t> children(count, 0);
+
+        for (uint32_t i = 1; i < count && valid; ++i) {
+            uint32_t p = parents[i];
+            valid = p < i && subtreeSizes[i] >= 1 &&
+                    i - p < subtreeSizes[p] && subtreeSizes[i] <= subtreeSizes[p] - (i - p);
+            if (valid) {
+                ++children[p];
+            }
+        }
+
+        for (uint32_t i = 0; i < count && valid; ++i) {
+            valid = childCounts[i] == children[i] && childCounts[i] <= header.arity;
+        }
+
+        if (!valid) {
+            damaged();
+        }
+    }
+
+    /**
+     * @return The number of nodes
+     */
+    size_t size() const {
+        return header.nodeCount;
+    }
+
+    /**
+     * @return true if the tree has no nodes
+     */
+    bool empty() const {
+        return header.nodeCount == 0;
+    }
+
+    /**
+     * @return The maximum number of children of the saved tree
+     */
+    size_t arity() const {
+        return header.arity;
+    }
+
+    /**
+     * @param i The index of a node
+     * @return The value of the node
+     */
+    value_reference value(uint32_t i) const {
+        check_node(i);
+        if constexpr (STRING_VALUES) {
+            uint64_t start = stringStarts[i], end = stringStarts[i + 1];
+            if (start > end || end > header.blobSize) {
+                damaged();
+            }
+            return string_view(blob + start, end - start);
+        } else {
+            return values[i];
+        }
+    }
+
+    /**
+     * @param i The index of a node
+     * @return The index of the parent of the node, or NO_NODE for the root
+     */
+    uint32_t parent(uint32_t i) const {
+        check_node(i);
+        return parents[i];
+    }
+
+    /**
+     * @param i The index of a node
+     * @return The number of nodes in the subtree of the node, including it
+     */
+    uint32_t subtree_size(uint32_t i) const {
+        check_node(i);
+        return subtreeSizes[i];
+    }
+
+    /**
+     * @param i The index of a node
+     * @return The number of children of the node
+     */
+    uint32_t child_count(uint32_t i) const {
+        check_node(i);
+        return childCounts[i];
+    }
+
+    /**
+     * @param i The index of a node
+     * @return The index of the first child of the node, or NO_NODE if it has no children
+     */
+    uint32_t first_child(uint32_t i) const {
+        check_node(i);
+        return childCounts[i] > 0 ? i + 1 : NO_NODE;
+    }
+
+    /**
+     * @param i The index of a node
+     * @return The index of the next sibling of the node, or NO_NODE if it is the last child
+     */
+    uint32_t next_sibling(uint32_t i) const {
+        check_node(i);
+        uint32_t next = i + subtreeSizes[i];
+        uint32_t p = parents[i];
+        if (p != NO_NODE && p >= header.nodeCount) {
+            damaged();
+        }
+        return (p != NO_NODE && next < p + subtreeSizes[p]) ? next : NO_NODE;
+    }
+
+    /**
+     * @return The values in pre-order
+     */
+    typename FrozenTree<T>::template Range<Iterator> pre_order() const {
+        return typename FrozenTree<T>::template Range<Iterator>(Iterator(this, 0), Iterator(this, size()), size());
+    }
+};
+
+/**
+ * Save a frozen tree to a tree file
+ *
+ * @param tree The frozen tree
+ * @param arity The maximum number of children of the tree
+ * @param path The file path
+ *
+ * @throws runtime_error if the file can't be written
+ */
+template <typename T>
+void save_tree_file(const FrozenTree<T> &tree, size_t arity, const string &path) {
+    constexpr bool stringValues = MappedTree<T>::STRING_VALUES;
+    uint64_t count = tree.size();
+
+    auto align = [](uint64_t offset) {
+        return (offset + TREE_FILE_ALIGNMENT - 1) / TREE_FILE_ALIGNMENT * TREE_FILE_ALIGNMENT;
+    };
+
+    TreeFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TREE_FILE_MAGIC, sizeof(TREE_FILE_MAGIC));
+    header.version = TREE_FILE_VERSION;
+    header.byteOrder = TREE_FILE_BYTE_ORDER;
+    header.valueKind = stringValues ? TREE_FILE_STRING_VALUES : TREE_FILE_RAW_VALUES;
+    header.valueSize = stringValues ? 0 : sizeof(T);
+    header.arity = arity;
+    header.nodeCount = count;
+
+    // The string offset table
+    vector<uint64_t> stringStarts;
+    if constexpr (stringValues) {
+        stringStarts.reserve(count + 1);
+        stringStarts.push_back(0);
+        for (uint64_t i = 0; i < count; ++i) {
+            stringStarts.push_back(stringStarts.back() + tree.value(i).size());
+        }
+        header.blobSize = stringStarts.back();
+    }
+
+    // The section layout
+    header.valuesOffset = align(sizeof(TreeFileHeader));
+    uint64_t end = header.valuesOffset + (stringValues ? (count + 1) * sizeof(uint64_t) : count * sizeof(T));
+    header.blobOffset = align(end);
+    end = header.blobOffset + header.blobSize;
+    header.parentsOffset = align(end);
+    header.subtreeSizesOffset = align(header.parentsOffset + count * sizeof(uint32_t));
+    header.childCountsOffset = align(header.subtreeSizesOffset + count * sizeof(uint32_t));
+    header.fileSize = header.childCountsOffset + count * sizeof(uint32_t);
+
+    ofstream out(path, ios::binary | ios::trunc);
+    if (!out) {
+        throw runtime_error("############ Error: Can't write the tree file... ############");
+    }
+
+    uint64_t written = 0;
+    auto write_at = [&](uint64_t offset, const void *data, uint64_t size) {
+        static const char padding[TREE_FILE_ALIGNMENT] = {};
+        out.write(padding, static_cast<streamsize>(offset - written));
+        if (size > 0) {
+            out.write(static_cast<const char *>(data), static_cast<streamsize>(size));
+        }
+        written = offset + size;
+    };
+
+    write_at(0, &header, sizeof(header));
+
+    if constexpr (stringValues) {
+        write_at(header.valuesOffset, stringStarts.data(), stringStarts.size() * sizeof(uint64_t));
+        write_at(header.blobOffset, nullptr, 0);
+        for (uint64_t i = 0; i < count; ++i) {
+            write_at(written, tree.value(i).data(), tree.value(i).size());
+        }
+    } else {
+        write_at(header.valuesOffset, tree.value_data(), count * sizeof(T));
+    }
+
+    write_at(header.parentsOffset, tree.parent_data(), count * sizeof(uint32_t));
+    write_at(header.subtreeSizesOffset, tree.subtree_size_data(), count * sizeof(uint32_t));
+    write_at(header.childCountsOffset, tree.child_count_data(), count * sizeof(uint32_t));
+
+    if (!out.flush()) {
+        throw runtime_error("############ Error: Can't write the tree file... ############");
+    }
+}
+
+#endif // TREE_FILE_HPP
@@ -0,0 +1,457 @@
+// noavrd@gmail.com
+
+#ifndef TREE_LAYOUT_HPP
+#define TREE_LAYOUT_HPP
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace std;
+
+/**
+ * The box around all the node centers of a layout
+ */
+struct LayoutBounds {
+    float left;
+    float top;
+    float right;
+    float bottom;
+};
+
+/**
+ * TreeLayout class template
+ *
+ * The positions of the nodes of a tree for drawing it, with the Reingold-Tilford tidy tree algorithm in the linear
+ * time form of Walker and Buchheim et al.: every subtree is laid out once and moved as a whole, no two nodes get
+ * closer than the node spacing, and a parent is centered over its children, at any depth.
+ *
+ * The nodes are numbered in pre-order by compute(), and nodes added later with add_node() get the next numbers,
+ * so a parent always has a smaller number than its children. The node pointer, parent and position of each node
+ * are kept in flat arrays indexed by that number, so drawing is a scan over arrays with no lookups.
+ * The root is at (0, 0) and y grows down.
+ *
+ * The x of a node is kept relative to its parent (offset()), so moving a subtree is one number. After add_node()
+ * only the subtrees on the path from the new node to the root are laid out again, and only the offsets of the
+ * children of that path change: an insert costs the path and the contours of its subtrees, not the tree.
+ * The x of a node (x()) is the sum of the offsets above it, kept in a cache that is filled on the first read
+ * after a change, with the parents before their children - so reading a node is O(1) when its parent was read.
+ * Filling the cache is why one layout must not be read from several threads at once.
+ *
+ * @tparam NodeType The node type of the tree
+ */
+template <typename NodeType>
+class TreeLayout {
+public:
+    // Marks a missing node (like the parent of the root)
+    static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+private:
+    /**
+     * The state of the tidy tree walk for one node
+     */
+    struct WalkNode {
+        uint32_t firstChild = NO_NODE;
+        uint32_t lastChild = NO_NODE;
+        uint32_t previousSibling = NO_NODE;
+        uint32_t nextSibling = NO_NODE;
+        uint32_t number = 0;               // The position among its siblings
+        uint32_t depth = 0;
+        double prelim = 0.0;               // The x relative to the parent's subtree, before the modifiers
+        double mod = 0.0;                  // Added to the x of every node under this one
+        double change = 0.0;               // The shifts of the siblings between two moved subtrees
+        double shift = 0.0;
+        double mid = 0.0;                  // The middle of its children, when they are laid out
+        uint32_t thread = NO_NODE;         // The next node of the contour, for a leaf
+        double threadMod = 0.0;            // What the thread added to mod
+        uint32_t threadNext = NO_NODE;     // The next leaf threaded by the same node
+        uint32_t threadsMade = NO_NODE;    // The first leaf this node threaded
+        uint32_t ancestor = NO_NODE;       // The sibling subtree this contour node is in, only valid in ancestorStep
+        uint64_t ancestorStep = 0;
+    };
+
+    float levelSpacing;        // The vertical distance between levels
+    float nodeSpacing;         // The smallest horizontal distance between two nodes of a level
+    vector<NodeType *> nodes;  // The nodes by number
+    vector<uint32_t> parents;  // The parent of every node
+    vector<double> offsets;    // The x of every node relative to its parent
+    vector<WalkNode> walk;
+    mutable vector<double> xs;         // The x of every node, valid if its placedIn is placement
+    mutable vector<uint64_t> placedIn;
+    mutable vector<uint32_t> unplaced; // The ancestors update_x fills, kept to not allocate on every read
+    uint64_t placement;        // Counts the changes of the offsets, so the old xs are ignored
+    mutable unordered_map<const NodeType *, uint32_t> numbers; // The number of every node, made on the first lookup
+    uint64_t step;             // Counts the walk steps, so old ancestor links are ignored
+
+    // Most layouts are only drawn, so the numbers of the nodes are only hashed when a node is looked up
+    uint32_t find_number(const NodeType *node) const {
+        if (numbers.empty()) {
+            numbers.reserve(nodes.size());
+            for (size_t i = 0; i < nodes.size(); ++i) {
+                numbers[nodes[i]] = static_cast<uint32_t>(i);
+            }
+        }
+
+        auto found = numbers.find(node);
+        return found == numbers.end() ? NO_NODE : found->second;
+    }
+
+    bool is_leaf(uint32_t v) const {
+        return walk[v].firstChild == NO_NODE;
+    }
+
+    uint32_t next_left(uint32_t v) const {
+        return is_leaf(v) ? walk[v].thread : walk[v].firstChild;
+    }
+
+    uint32_t next_right(uint32_t v) const {
+        return is_leaf(v) ? walk[v].thread : walk[v].lastChild;
+    }
+
+    // Add a node (and everything under it) with the next numbers, in pre-order
+    void append_subtree(NodeType *root, uint32_t parent) {
+        vector<pair<NodeType *, uint32_t>> stack{{root, parent}};
+
+        while (!stack.empty()) {
+            auto [node, up] = stack.back();
+            stack.pop_back();
+
+            if (nodes.size() >= NO_NODE) {
+                throw runtime_error("############ Error: Too many nodes to lay out... ############");
+            }
+            uint32_t v = static_cast<uint32_t>(nodes.size());
+            nodes.push_back(node);
+            parents.push_back(up);
+            offsets.push_back(0.0);
+            xs.push_back(0.0);
+            placedIn.push_back(0);
+            walk.emplace_back();
+            if (!numbers.empty()) {
+                numbers[node] = v;
+            }
+
+            if (up != NO_NODE) {
+                WalkNode &p = walk[up];
+                walk[v].depth = walk[up].depth + 1;
+                walk[v].previousSibling = p.lastChild;
+                if (p.lastChild == NO_NODE) {
+                    p.firstChild = v;
+                } else {
+                    walk[v].number = walk[p.lastChild].number + 1;
+                    walk[p.lastChild].nextSibling = v;
+                }
+                p.lastChild = v;
+            }
+
+            auto children = node->get_children();
+            for (size_t i = children.size(); i-- > 0;) {
+                if (children[i]) {
+                    stack.push_back({children[i], v});
+                }
+            }
+        }
+    }
+
+    // Place a child after its left sibling, its own children are already laid out
+    void place(uint32_t w) {
+        WalkNode &node = walk[w];
+        uint32_t left = node.previousSibling;
+
+        node.change = node.shift = 0.0;
+        if (left != NO_NODE) {
+            node.prelim = walk[left].prelim + nodeSpacing;
+            node.mod = is_leaf(w) ? 0.0 : node.prelim - node.mid;
+        } else {
+            node.prelim = is_leaf(w) ? 0.0 : node.mid;
+            node.mod = 0.0;
+        }
+    }
+
+    // Spread a move of a subtree over the subtrees between it and the one it was moved away from
+    void move_subtree(uint32_t wl, uint32_t wr, double shift) {
+        double subtrees = static_cast<double>(walk[wr].number - walk[wl].number);
+        walk[wr].change -= shift / subtrees;
+        walk[wr].shift += shift;
+        walk[wl].change += shift / subtrees;
+        walk[wr].prelim += shift;
+        walk[wr].mod += shift;
+    }
+
+    void make_thread(uint32_t owner, uint32_t leaf, uint32_t target, double modifier) {
+        walk[leaf].thread = target;
+        walk[leaf].mod += modifier;
+        walk[leaf].threadMod = modifier;
+        walk[leaf].threadNext = walk[owner].threadsMade;
+        walk[owner].threadsMade = leaf;
+    }
+
+    // Push the subtree of v right of its left siblings' subtrees, level by level along their contours
+    uint32_t apportion(uint32_t parent, uint32_t v, uint32_t defaultAncestor) {
+        uint32_t w = walk[v].previousSibling;
+        if (w == NO_NODE) {
+            return defaultAncestor;
+        }
+
+        uint32_t vir = v, vor = v, vil = w, vol = walk[parent].firstChild;
+        double sir = walk[vir].mod, sor = walk[vor].mod, sil = walk[vil].mod, sol = walk[vol].mod;
+
+        while (next_right(vil) != NO_NODE && next_left(vir) != NO_NODE) {
+            vil = next_right(vil);
+            vir = next_left(vir);
+            vol = next_left(vol);
+            vor = next_right(vor);
+            walk[vor].ancestor = v;
+            walk[vor].ancestorStep = step;
+
+            double shift = (walk[vil].prelim + sil) - (walk[vir].prelim + sir) + nodeSpacing;
+            if (shift > 0.0) {
+                uint32_t ancestor = walk[vil].ancestor;
+                bool sibling = walk[vil].ancestorStep == step && parents[ancestor] == parent;
+                move_subtree(sibling ? ancestor : defaultAncestor, v, shift);
+                sir += shift;
+                sor += shift;
+            }
+
+            sil += walk[vil].mod;
+            sir += walk[vir].mod;
+            sol += walk[vol].mod;
+            sor += walk[vor].mod;
+        }
+
+        if (next_right(vil) != NO_NODE && next_right(vor) == NO_NODE) {
+            make_thread(parent, vor, next_right(vil), sil - sor);
+        }
+        if (next_left(vir) != NO_NODE && next_left(vol) == NO_NODE) {
+            make_thread(parent, vol, next_left(vir), sir - sol);
+            defaultAncestor = v;
+        }
+
+        return defaultAncestor;
+    }
+
+    // Lay out the children of v (whose own children are laid out) side by side, and center them under v
+    void lay_out_children(uint32_t v) {
+        ++step;
+        if (is_leaf(v)) {
+            walk[v].mid = 0.0;
+            return;
+        }
+
+        uint32_t defaultAncestor = walk[v].firstChild;
+        for (uint32_t w = walk[v].firstChild; w != NO_NODE; w = walk[w].nextSibling) {
+            place(w);
+            defaultAncestor = apportion(v, w, defaultAncestor);
+        }
+
+        double shift = 0.0, change = 0.0;
+        for (uint32_t w = walk[v].lastChild; w != NO_NODE; w = walk[w].previousSibling) {
+            walk[w].prelim += shift;
+            walk[w].mod += shift;
+            change += walk[w].change;
+            shift += walk[w].shift + change;
+        }
+
+        walk[v].mid = (walk[walk[v].firstChild].prelim + walk[walk[v].lastChild].prelim) / 2.0;
+    }
+
+    // Remove the contour threads a node made when its children were laid out
+    void undo_threads(uint32_t v) {
+        for (uint32_t leaf = walk[v].threadsMade; leaf != NO_NODE; leaf = walk[leaf].threadNext) {
+            walk[leaf].thread = NO_NODE;
+            walk[leaf].mod -= walk[leaf].threadMod;
+            walk[leaf].threadMod = 0.0;
+        }
+        walk[v].threadsMade = NO_NODE;
+    }
+
+    // Set the offsets of the children of v from their walk, once their positions in the subtree of v are final
+    void set_offsets(uint32_t v) {
+        for (uint32_t w = walk[v].firstChild; w != NO_NODE; w = walk[w].nextSibling) {
+            offsets[w] = walk[w].prelim + walk[v].mod - walk[v].prelim;
+        }
+    }
+
+    // The root is centered over its children, and moves nothing under it
+    void center_root() {
+        walk[0].prelim = walk[0].mid;
+        walk[0].mod = 0.0;
+    }
+
+    // Fill the x of a node, and of its ancestors whose x is out of date, from the closest one that is not
+    void update_x(uint32_t v) const {
+        unplaced.clear();
+        for (; v != NO_NODE && placedIn[v] != placement; v = parents[v]) {
+            unplaced.push_back(v);
+        }
+
+        for (size_t k = unplaced.size(); k-- > 0;) {
+            uint32_t w = unplaced[k];
+            xs[w] = parents[w] == NO_NODE ? 0.0 : xs[parents[w]] + offsets[w];
+            placedIn[w] = placement;
+        }
+    }
+
+public:
+    /**
+     * Constructs an empty layout
+     *
+     * @param levelSpacing The vertical distance between levels
+     * @param nodeSpacing The smallest horizontal distance between two nodes of the same level
+     */
+    explicit TreeLayout(float levelSpacing = 200.f, float nodeSpacing = 125.f)
+        : levelSpacing(levelSpacing), nodeSpacing(nodeSpacing), placement(1), step(0) {}
+
+    /**
+     * Computes the positions of all the nodes under a root, in linear time
+     *
+     * @param root The root of the tree, nullptr for an empty layout
+     */
+    void compute(NodeType *root) {
+        nodes.clear();
+        parents.clear();
+        offsets.clear();
+        walk.clear();
+        xs.clear();
+        placedIn.clear();
+        numbers.clear();
+        ++placement;
+
+        if (!root) {
+            return;
+        }
+
+        append_subtree(root, NO_NODE);
+
+        // Children have bigger numbers than their parents, so they are laid out first
+        for (size_t v = nodes.size(); v-- > 0;) {
+            lay_out_children(static_cast<uint32_t>(v));
+        }
+
+        // Every x is read for a whole layout, so they are all filled now in one pass
+        center_root();
+        for (size_t v = 0; v < nodes.size(); ++v) {
+            set_offsets(static_cast<uint32_t>(v));
+            update_x(static_cast<uint32_t>(v));
+        }
+    }
+
+    /**
+     * Adds a node (with everything under it) that was added to the tree after compute(), and moves the others
+     *
+     * Only the new subtree and its ancestors are laid out again - the rest of the tree is moved, not walked,
+     * and a moved subtree is only a new offset of its root. The other xs are filled again when they are read.
+     *
+     * @param parent The parent of the new node, already in the layout
+     * @param child The new node, the last child of parent
+     * @return uint32_t The number of the new node
+     *
+     * @throws runtime_error if the parent is not in the layout
+     */
+    uint32_t add_node(const NodeType *parent, NodeType *child) {
+        uint32_t up = find_number(parent);
+        if (up == NO_NODE) {
+            throw runtime_error("############ Error: The parent is not in the layout... ############");
+        }
+
+        uint32_t first = static_cast<uint32_t>(nodes.size());
+        append_subtree(child, up);
+
+        for (size_t v = nodes.size(); v-- > first;) {
+            lay_out_children(static_cast<uint32_t>(v));
+        }
+
+        // The threads of the ancestors go through the old contours, so they are all removed before any is walked again
+        for (uint32_t v = up; v != NO_NODE; v = parents[v]) {
+            undo_threads(v);
+        }
+        for (uint32_t v = up; v != NO_NODE; v = parents[v]) {
+            lay_out_children(v);
+        }
+
+        center_root();
+        for (uint32_t v = up; v != NO_NODE; v = parents[v]) {
+            set_offsets(v);
+        }
+        for (size_t v = first; v < nodes.size(); ++v) {
+            set_offsets(static_cast<uint32_t>(v));
+        }
+
+        ++placement;
+        return first;
+    }
+
+    /**
+     * Returns the number of a node
+     *
+     * @param node The node
+     * @return uint32_t Its number, NO_NODE if it is not in the layout
+     */
+    uint32_t number_of(const NodeType *node) const {
+        return find_number(node);
+    }
+
+    size_t size() const {
+        return nodes.size();
+    }
+
+    NodeType *node(size_t i) const {
+        return nodes[i];
+    }
+
+    uint32_t parent(size_t i) const {
+        return parents[i];
+    }
+
+    uint32_t first_child(size_t i) const {
+        return walk[i].firstChild;
+    }
+
+    uint32_t next_sibling(size_t i) const {
+        return walk[i].nextSibling;
+    }
+
+    float level_spacing() const {
+        return levelSpacing;
+    }
+
+    /**
+     * Returns the x of a node relative to its parent (0 for the root)
+     *
+     * @param i The number of the node
+     * @return double The offset
+     */
+    double offset(size_t i) const {
+        return offsets[i];
+    }
+
+    float x(size_t i) const {
+        if (placedIn[i] != placement) {
+            update_x(static_cast<uint32_t>(i));
+        }
+        return static_cast<float>(xs[i]);
+    }
+
+    float y(size_t i) const {
+        return walk[i].depth * levelSpacing;
+    }
+
+    /**
+     * Returns the box around all the node centers, it reads every x
+     *
+     * @return LayoutBounds The box, all zeros for an empty layout
+     */
+    LayoutBounds bounds() const {
+        LayoutBounds box{0.f, 0.f, 0.f, 0.f};
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            box.left = min(box.left, x(i));
+            box.right = max(box.right, x(i));
+            box.bottom = max(box.bottom, y(i));
+        }
+        return box;
+    }
+};
+
+#endif // TREE_LAYOUT_HPP
@@ -0,0 +1,442 @@
+// noavrd@gmail.com
+
+#ifndef TREE_RENDERER_HPP
+#define TREE_RENDERER_HPP
+
+#include <cmath>
+#include <array>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <SFML/Graphics.hpp>
+
+#include "tree_layout.hpp"
+#include "layout_index.hpp"
+#include "tree_snapshot.hpp"
+
+using namespace std;
+
+/**
+ * How the renderer draws a tree
+ */
+struct RenderStyle {
+    float nodeRadius = 50.f;
+    float outlineThickness = 3.f;
+    float levelSpacing = 200.f;
+    float nodeSpacing = 125.f;
+    unsigned fontSize = 20;
+    float labelRadius = 10.f;  // The smallest radius on screen (in pixels) the labels are drawn at
+    float summarySize = 8.f;   // Subtrees smaller than this on screen (in pixels) both ways, nodes included, are one summary
+    sf::Color nodeColor = sf::Color(173, 216, 230);
+    sf::Color lineColor = sf::Color::Black;
+    sf::Color textColor = sf::Color::Black;
+    sf::Color backgroundColor = sf::Color::White;
+    sf::Color summaryColor = sf::Color(120, 160, 200, 160);
+};
+
+/**
+ * TreeRenderer class template
+ *
+ * Draws a tree with SFML in four draw calls, whatever its size: one vertex array for the lines, one for the circles
+ * (quads of a circle drawn once to a texture), one for the labels (quads of the font glyphs) and one for the summaries.
+ * The labels are formatted once per node and the glyphs of the font are looked up once per character.
+ *
+ * Only what is in the view is put in the vertex arrays: the subtrees out of it are skipped with the subtree boxes
+ * of a LayoutIndex, subtrees too small to see at the zoom are drawn as one summary (a circle and a triangle
+ * over the subtree) and the labels are left out when the circles are too small to read them. So a frame costs what
+ * is on the screen and not the size of the tree. The vertex arrays are only built again when the view or the tree
+ * version changes - drawing a frame just hands them to the GPU.
+ *
+ * The tree and the font must live longer than the renderer.
+ *
+ * @tparam TreeType The tree type
+ */
+template <typename TreeType>
+class TreeRenderer : public sf::Drawable {
+public:
+    using NodeType = typename TreeType::NodeType;
+
+private:
+    /**
+     * The text of a node and the middle of its glyphs, from the pen position
+     */
+    struct Label {
+        string text;
+        float centerX;
+        float centerY;
+    };
+
+    const TreeType &tree;
+    const sf::Font &font;
+    RenderStyle style;
+    TreeLayout<NodeType> layout;
+    LayoutIndex<NodeType> index;
+    vector<Label> labels;             // The label of every node, by layout number
+    array<sf::Glyph, 256> glyphs;     // The glyphs of the characters used so far
+    array<bool, 256> glyphLoaded;
+    sf::RenderTexture circleTexture;  // One node circle with its outline
+    sf::VertexArray lines;
+    sf::VertexArray circles;
+    sf::VertexArray text;
+    sf::VertexArray summaries;
+    uint64_t laidOutVersion;          // The tree version of the layout
+    bool laidOut;
+    bool geometryDirty;               // true if the layout changed since the vertex arrays were built
+    LayoutBounds viewArea;            // The view the vertex arrays were built for
+    float pixelsPerUnit;
+    size_t rebuilds;                  // The number of times the vertex arrays were built
+    size_t visibleNodes;              // The number of circles in the vertex arrays
+    size_t summaryCount;              // The number of summaries in the vertex arrays
+
+    const sf::Glyph &glyph(unsigned char c) {
+        if (!glyphLoaded[c]) {
+            glyphs[c] = font.getGlyph(c, style.fontSize, true);
+            glyphLoaded[c] = true;
+        }
+        return glyphs[c];
+    }
+
+    // Format the labels of the nodes from a layout number on, and find the middle of their glyphs
+    void make_labels(size_t first) {
+        labels.resize(layout.size());
+
+        for (size_t i = first; i < layout.size(); ++i) {
+            Label &label = labels[i];
+            label.text = node_label(layout.node(i)->get_value());
+
+            float pen = 0.f, left = 0.f, right = 0.f, top = 0.f, bottom = 0.f;
+            bool any = false;
+            unsigned char previous = 0;
+
+            for (char c : label.text) {
+                unsigned char code = static_cast<unsigned char>(c);
+                pen += previous ? font.getKerning(previous, code, style.fontSize) : 0.f;
+
+                const sf::Glyph &g = glyph(code);
+                if (g.bounds.width > 0.f) {
+                    float glyphLeft = pen + g.bounds.left, glyphRight = glyphLeft + g.bounds.width;
+                    float glyphTop = g.bounds.top, glyphBottom = glyphTop + g.bounds.height;
+                    left = any ? min(left, glyphLeft) : glyphLeft;
+                    right = any ? max(right, glyphRight) : glyphRight;
+                    top = any ? min(top, glyphTop) : glyphTop;
+                    bottom = any ? max(bottom, glyphBottom) : glyphBottom;
+                    any = true;
+                }
+
+                pen += g.advance;
+                previous = code;
+            }
+
+            label.centerX = (left + right) / 2.f;
+            label.centerY = (top + bottom) / 2.f;
+        }
+    }
+
+    static void add_quad(sf::VertexArray &vertices, sf::FloatRect box, sf::FloatRect texture, sf::Color color) {
+        sf::Vector2f topLeft(box.left, box.top), bottomRight(box.left + box.width, box.top + box.height);
+        sf::Vector2f topRight(bottomRight.x, topLeft.y), bottomLeft(topLeft.x, bottomRight.y);
+        sf::Vector2f texTopLeft(texture.left, texture.top), texBottomRight(texture.left + texture.width, texture.top + texture.height);
+        sf::Vector2f texTopRight(texBottomRight.x, texTopLeft.y), texBottomLeft(texTopLeft.x, texBottomRight.y);
+
+        vertices.append(sf::Vertex(topLeft, color, texTopLeft));
+        vertices.append(sf::Vertex(topRight, color, texTopRight));
+        vertices.append(sf::Vertex(bottomLeft, color, texBottomLeft));
+        vertices.append(sf::Vertex(bottomLeft, color, texBottomLeft));
+        vertices.append(sf::Vertex(topRight, color, texTopRight));
+        vertices.append(sf::Vertex(bottomRight, color, texBottomRight));
+    }
+
+    void add_label(size_t i) {
+        const Label &label = labels[i];
+        float pen = -label.centerX;
+        unsigned char previous = 0;
+        for (char c : label.text) {
+            unsigned char code = static_cast<unsigned char>(c);
+            pen += previous ? font.getKerning(previous, code, style.fontSize) : 0.f;
+
+            const sf::Glyph &g = glyph(code);
+            if (g.bounds.width > 0.f) {
+                sf::FloatRect box(layout.x(i) + pen + g.bounds.left, layout.y(i) - label.centerY + g.bounds.top, g.bounds.width, g.bounds.height);
+                sf::FloatRect texture(static_cast<float>(g.textureRect.left), static_cast<float>(g.textureRect.top),
+                                      static_cast<float>(g.textureRect.width), static_cast<float>(g.textureRect.height));
+                add_quad(text, box, texture, style.textColor);
+            }
+
+            pen += g.advance;
+            previous = code;
+        }
+    }
+
+    void add_circle(size_t i, bool withLabel) {
+        float size = static_cast<float>(circleTexture.getSize().x);
+        add_quad(circles, sf::FloatRect(layout.x(i) - size / 2.f, layout.y(i) - size / 2.f, size, size),
+                 sf::FloatRect(0.f, 0.f, size, size), sf::Color::White);
+        if (withLabel) {
+            add_label(i);
+        }
+        ++visibleNodes;
+    }
+
+    // The lines from a node to its children that can cross the area (a line is in the box of its two ends),
+    // the children are from left to right so at most one line ends in each pixel
+    void add_child_lines(size_t i, const LayoutBounds &area) {
+        sf::Vector2f from(layout.x(i), layout.y(i));
+        float pixel = 1.f / pixelsPerUnit, last = -numeric_limits<float>::infinity();
+        for (uint32_t child = layout.first_child(i); child != layout.NO_NODE; child = layout.next_sibling(child)) {
+            float x = layout.x(child);
+            if (x - last >= pixel && min(from.x, x) <= area.right && max(from.x, x) >= area.left) {
+                lines.append(sf::Vertex(from, style.lineColor));
+                lines.append(sf::Vertex(sf::Vector2f(x, layout.y(child)), style.lineColor));
+                last = x;
+            }
+        }
+    }
+
+    // A triangle from the subtree root down over the whole subtree box
+    void add_summary(size_t i) {
+        const LayoutBounds &box = index.subtree_bounds(i);
+        summaries.append(sf::Vertex(sf::Vector2f(layout.x(i), layout.y(i)), style.summaryColor));
+        summaries.append(sf::Vertex(sf::Vector2f(box.left, box.bottom), style.summaryColor));
+        summaries.append(sf::Vertex(sf::Vector2f(box.right, box.bottom), style.summaryColor));
+        ++summaryCount;
+    }
+
+    // Build the vertex arrays for what is in an area of the layout
+    void build_vertices() {
+        lines.clear();
+        circles.clear();
+        text.clear();
+        summaries.clear();
+        visibleNodes = 0;
+        summaryCount = 0;
+
+        // A circle is drawn if any of it is in the view
+        float reach = style.nodeRadius + style.outlineThickness;
+        LayoutBounds area{viewArea.left - reach, viewArea.top - reach, viewArea.right + reach, viewArea.bottom + reach};
+        auto in_area = [&](size_t i) {
+            return layout.x(i) >= area.left && layout.x(i) <= area.right && layout.y(i) >= area.top && layout.y(i) <= area.bottom;
+        };
+        bool withLabels = style.nodeRadius * pixelsPerUnit >= style.labelRadius;
+
+        index.for_each_level_of_detail(area, style.summarySize / pixelsPerUnit, 2.f * reach,
+            [&](uint32_t i) {
+                add_child_lines(i, area);
+                if (in_area(i)) {
+                    add_circle(i, withLabels);
+                }
+            },
+            [&](uint32_t i) {
+                add_summary(i);
+                if (in_area(i)) {
+                    add_circle(i, false);
+                }
+            });
+
+        geometryDirty = false;
+        ++rebuilds;
+    }
+
+    // The area of the layout a view shows, and its pixels per layout unit
+    static void view_area(const sf::View &view, sf::Vector2u targetSize, LayoutBounds &area, float &scale) {
+        sf::Vector2f center = view.getCenter(), size = view.getSize();
+        area = {center.x - size.x / 2.f, center.y - size.y / 2.f, center.x + size.x / 2.f, center.y + size.y / 2.f};
+        scale = size.x > 0.f ? static_cast<float>(targetSize.x) / size.x : 1.f;
+    }
+
+    bool same_view(const LayoutBounds &area, float scale) const {
+        return area.left == viewArea.left && area.top == viewArea.top && area.right == viewArea.right &&
+               area.bottom == viewArea.bottom && scale == pixelsPerUnit;
+    }
+
+protected:
+    void draw(sf::RenderTarget &target, sf::RenderStates states) const override {
+        target.draw(lines, states);
+        target.draw(summaries, states);
+
+        states.texture = &circleTexture.getTexture();
+        target.draw(circles, states);
+
+        states.texture = &font.getTexture(style.fontSize);
+        target.draw(text, states);
+    }
+
+public:
+    /**
+     * Constructs a renderer, the tree is laid out by the first update() and drawn after the first set_view()
+     * The root is at (0, 0) and the levels go down
+     *
+     * @param tree The tree to draw
+     * @param font The font of the labels
+     * @param style How the tree looks
+     *
+     * @throws runtime_error if the circle texture can't be made
+     */
+    TreeRenderer(const TreeType &tree, const sf::Font &font, const RenderStyle &style = RenderStyle())
+        : tree(tree), font(font), style(style), layout(style.levelSpacing, style.nodeSpacing),
+          lines(sf::Lines), circles(sf::Triangles), text(sf::Triangles), summaries(sf::Triangles),
+          laidOutVersion(0), laidOut(false), geometryDirty(true), viewArea{0.f, 0.f, 0.f, 0.f}, pixelsPerUnit(1.f),
+          rebuilds(0), visibleNodes(0), summaryCount(0) {
+        glyphLoaded.fill(false);
+
+        // The circle with its outline and a pixel of margin for the smoothing
+        float outer = style.nodeRadius + style.outlineThickness;
+        unsigned size = static_cast<unsigned>(ceil(2.f * outer)) + 2;
+        if (!circleTexture.create(size, size)) {
+            throw runtime_error("############ Error: Can't make the circle texture... ############");
+        }
+
+        sf::CircleShape circle(style.nodeRadius, 60);
+        circle.setFillColor(style.nodeColor);
+        circle.setOutlineColor(style.lineColor);
+        circle.setOutlineThickness(style.outlineThickness);
+        circle.setPosition(size / 2.f - style.nodeRadius, size / 2.f - style.nodeRadius);
+
+        circleTexture.clear(sf::Color::Transparent);
+        circleTexture.draw(circle);
+        circleTexture.display();
+        circleTexture.setSmooth(true);
+    }
+
+    /**
+     * Lays out the tree again if it changed since the last time
+     *
+     * @return true if it was laid out again
+     */
+    bool update() {
+        if (laidOut && tree.get_version() == laidOutVersion) {
+            return false;
+        }
+
+        layout.compute(tree.get_root());
+        make_labels(0);
+        index.build(layout);
+        laidOutVersion = tree.get_version();
+        laidOut = true;
+        geometryDirty = true;
+        return true;
+    }
+
+    /**
+     * Adds a node that was just added to the tree, laying out, labeling and indexing only what changed:
+     * the new nodes and the path from them to the root
+     *
+     * @param parent The parent of the new node
+     * @param child The new node (with everything under it)
+     *
+     * @throws runtime_error if the parent is not drawn
+     */
+    void add_node(const NodeType *parent, NodeType *child) {
+        if (!laidOut) {
+            update();
+            return;
+        }
+
+        uint32_t first = layout.add_node(parent, child);
+        make_labels(first);
+        index.add_nodes(first);
+        laidOutVersion = tree.get_version();
+        geometryDirty = true;
+    }
+
+    /**
+     * Builds the vertex arrays for a view, if it or the layout changed since the last time
+     *
+     * @param view The view the tree is drawn with
+     * @param targetSize The size of the window in pixels, for the zoom
+     * @return true if they were built again
+     */
+    bool set_view(const sf::View &view, sf::Vector2u targetSize) {
+        LayoutBounds area;
+        float scale;
+        view_area(view, targetSize, area, scale);
+
+        if (!geometryDirty && same_view(area, scale)) {
+            return false;
+        }
+
+        viewArea = area;
+        pixelsPerUnit = scale;
+        build_vertices();
+        return true;
+    }
+
+    /**
+     * Checks if what was built is still right, without building anything - update() and set_view() would do nothing
+     *
+     * @param view The view the tree is drawn with
+     * @param targetSize The size of the window in pixels
+     * @return true if the tree did not change and the view is the same
+     */
+    bool is_current(const sf::View &view, sf::Vector2u targetSize) const {
+        if (!laidOut || tree.get_version() != laidOutVersion || geometryDirty) {
+            return false;
+        }
+
+        LayoutBounds area;
+        float scale;
+        view_area(view, targetSize, area, scale);
+        return same_view(area, scale);
+    }
+
+    /**
+     * Finds the node drawn at a point, with the subtree boxes of the layout index
+     *
+     * @param point A point in layout coordinates, like mapPixelToCoords gives
+     * @return const NodeType* The node, or nullptr if there is none there
+     */
+    const NodeType *node_at(sf::Vector2f point) const {
+        float r = style.nodeRadius;
+        const NodeType *found = nullptr;
+        index.for_each_in({point.x - r, point.y - r, point.x + r, point.y + r}, [&](uint32_t i) {
+            float dx = layout.x(i) - point.x, dy = layout.y(i) - point.y;
+            if (dx * dx + dy * dy <= r * r) {
+                found = layout.node(i);
+            }
+        });
+        return found;
+    }
+
+    const TreeLayout<NodeType> &get_layout() const {
+        return layout;
+    }
+
+    /**
+     * @return The number of draw calls of a frame
+     */
+    static constexpr size_t draw_calls() {
+        return 4;
+    }
+
+    /**
+     * @return The number of vertices sent for a frame
+     */
+    size_t vertex_count() const {
+        return lines.getVertexCount() + circles.getVertexCount() + text.getVertexCount() + summaries.getVertexCount();
+    }
+
+    /**
+     * @return The number of nodes drawn in the view
+     */
+    size_t visible_nodes() const {
+        return visibleNodes;
+    }
+
+    /**
+     * @return The number of subtrees drawn as one summary in the view
+     */
+    size_t summary_count() const {
+        return summaryCount;
+    }
+
+    /**
+     * @return The number of times the vertex arrays were built
+     */
+    size_t rebuild_count() const {
+        return rebuilds;
+    }
+};
+
+#endif // TREE_RENDERER_HPP
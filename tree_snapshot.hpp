@@ -0,0 +1,250 @@
+// noavrd@gmail.com
+
+#ifndef TREE_SNAPSHOT_HPP
+#define TREE_SNAPSHOT_HPP
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <charconv>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include "complex.hpp"
+#include "tree_layout.hpp"
+
+using namespace std;
+
+/**
+ * The text shown in the circle of a node, the same in the window and in the snapshots
+ *
+ * @param value The node value
+ * @return string The label
+ */
+template <typename T>
+string node_label(const T &value) {
+    if constexpr (is_same<T, string>::value) {
+        return value;
+    } else if constexpr (is_same<T, Complex>::value) {
+        ostringstream oss;
+        oss << value;
+        return oss.str();
+    } else {
+        return to_string(value);
+    }
+}
+
+/**
+ * How snapshots look, the same as the window of display_tree by default
+ */
+struct SnapshotStyle {
+    float nodeRadius = 50.f;
+    float levelSpacing = 200.f;
+    float nodeSpacing = 125.f;
+    float margin = 50.f;
+    unsigned fontSize = 20;
+    string nodeColor = "#add8e6";
+    string lineColor = "#000000";
+    string textColor = "#000000";
+    string backgroundColor = "#ffffff";
+};
+
+/**
+ * The time taken by each step of one snapshot
+ */
+struct SnapshotTiming {
+    double layoutMs; // Computing the node positions
+    double renderMs; // Making the SVG text
+    double writeMs;  // Writing the file (0 for render only)
+    size_t bytes;    // The size of the SVG text
+
+    double total_ms() const {
+        return layoutMs + renderMs + writeMs;
+    }
+};
+
+/**
+ * TreeSnapshotWriter class
+ *
+ * Draws trees to SVG images with no window and no graphics card, for headless machines and for batches of
+ * thousands of snapshots. The SVG text is made in one buffer that is kept between snapshots and is written
+ * to the file at once. The time of every snapshot is kept, and the totals over all of them.
+ */
+class TreeSnapshotWriter {
+private:
+    SnapshotStyle style;
+    string svg;             // The last snapshot, reused for the next one
+    SnapshotTiming last;    // The timing of the last snapshot
+    size_t frames;          // The number of snapshots so far
+    double totalMs;         // Their total time
+    double slowestMs;       // The time of the slowest one
+
+    static double elapsed_ms(chrono::steady_clock::time_point start) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    void append_number(float value) {
+        char text[32];
+        svg.append(text, to_chars(text, text + sizeof(text), value).ptr);
+    }
+
+    void append_escaped(const string &text) {
+        for (char c : text) {
+            switch (c) {
+            case '&': svg += "&amp;"; break;
+            case '<': svg += "&lt;"; break;
+            case '>': svg += "&gt;"; break;
+            case '"': svg += "&quot;"; break;
+            default: svg += c;
+            }
+        }
+    }
+
+    void append_attribute(const char *name, float value) {
+        svg += ' ';
+        svg += name;
+        svg += "=\"";
+        append_number(value);
+        svg += '"';
+    }
+
+    void count_frame(const SnapshotTiming &timing) {
+        last = timing;
+        ++frames;
+        totalMs += timing.total_ms();
+        slowestMs = max(slowestMs, timing.total_ms());
+    }
+
+    // Lay out the tree and make its SVG text, without counting a frame
+    template <typename TreeType>
+    SnapshotTiming draw(const TreeType &tree) {
+        auto start = chrono::steady_clock::now();
+        TreeLayout<typename TreeType::NodeType> layout(style.levelSpacing, style.nodeSpacing);
+        layout.compute(tree.get_root());
+        double layoutMs = elapsed_ms(start);
+
+        start = chrono::steady_clock::now();
+        LayoutBounds bounds = layout.bounds();
+        float pad = style.nodeRadius + style.margin;
+        float left = bounds.left - pad, top = bounds.top - pad;
+        float width = bounds.right - bounds.left + 2 * pad, height = bounds.bottom - bounds.top + 2 * pad;
+
+        svg.clear();
+        svg += "<svg xmlns=\"http://www.w3.org/2000/svg\"";
+        append_attribute("width", width);
+        append_attribute("height", height);
+        svg += " viewBox=\"";
+        append_number(left);
+        svg += ' ';
+        append_number(top);
+        svg += ' ';
+        append_number(width);
+        svg += ' ';
+        append_number(height);
+        svg += "\">\n<rect";
+        append_attribute("x", left);
+        append_attribute("y", top);
+        append_attribute("width", width);
+        append_attribute("height", height);
+        svg += " fill=\"" + style.backgroundColor + "\"/>\n";
+
+        // The lines first, so the circles cover their ends
+        svg += "<g stroke=\"" + style.lineColor + "\">\n";
+        for (size_t i = 0; i < layout.size(); ++i) {
+            uint32_t parent = layout.parent(i);
+            if (parent != layout.NO_NODE) {
+                svg += "<line";
+                append_attribute("x1", layout.x(parent));
+                append_attribute("y1", layout.y(parent));
+                append_attribute("x2", layout.x(i));
+                append_attribute("y2", layout.y(i));
+                svg += "/>\n";
+            }
+        }
+
+        svg += "</g>\n<g fill=\"" + style.nodeColor + "\" stroke=\"" + style.lineColor + "\" stroke-width=\"3\">\n";
+        for (size_t i = 0; i < layout.size(); ++i) {
+            svg += "<circle";
+            append_attribute("cx", layout.x(i));
+            append_attribute("cy", layout.y(i));
+            append_attribute("r", style.nodeRadius);
+            svg += "/>\n";
+        }
+
+        svg += "</g>\n<g font-family=\"Arial\" font-weight=\"bold\" font-size=\"" + to_string(style.fontSize) +
+               "\" fill=\"" + style.textColor + "\" text-anchor=\"middle\" dominant-baseline=\"central\">\n";
+        for (size_t i = 0; i < layout.size(); ++i) {
+            svg += "<text";
+            append_attribute("x", layout.x(i));
+            append_attribute("y", layout.y(i));
+            svg += '>';
+            append_escaped(node_label(layout.node(i)->get_value()));
+            svg += "</text>\n";
+        }
+        svg += "</g>\n</svg>\n";
+
+        return {layoutMs, elapsed_ms(start), 0.0, svg.size()};
+    }
+
+public:
+    explicit TreeSnapshotWriter(const SnapshotStyle &style = SnapshotStyle())
+        : style(style), last{0.0, 0.0, 0.0, 0}, frames(0), totalMs(0.0), slowestMs(0.0) {}
+
+    /**
+     * Draws a tree to SVG text in memory
+     *
+     * @param tree The tree
+     * @return const string& The SVG text, valid until the next snapshot
+     */
+    template <typename TreeType>
+    const string &render(const TreeType &tree) {
+        count_frame(draw(tree));
+        return svg;
+    }
+
+    /**
+     * Draws a tree to an SVG file
+     *
+     * @param tree The tree
+     * @param path The file path
+     * @return SnapshotTiming The time of each step
+     *
+     * @throws runtime_error if the file can't be written
+     */
+    template <typename TreeType>
+    SnapshotTiming save(const TreeType &tree, const string &path) {
+        SnapshotTiming timing = draw(tree);
+
+        auto start = chrono::steady_clock::now();
+        ofstream out(path, ios::binary);
+        out.write(svg.data(), static_cast<streamsize>(svg.size()));
+        out.close();
+        if (!out) {
+            throw runtime_error("############ Error: Can't write the snapshot file... ############");
+        }
+        timing.writeMs = elapsed_ms(start);
+
+        count_frame(timing);
+        return timing;
+    }
+
+    const SnapshotTiming &last_timing() const {
+        return last;
+    }
+
+    size_t frame_count() const {
+        return frames;
+    }
+
+    double total_ms() const {
+        return totalMs;
+    }
+
+    double slowest_ms() const {
+        return slowestMs;
+    }
+};
+
+#endif // TREE_SNAPSHOT_HPP
@@ -0,0 +1,45 @@
+// noavrd@gmail.com
+
+#include "window_waker.hpp"
+
+#if defined(SFML_SYSTEM_WINDOWS)
+#include <windows.h>
+#elif defined(SFML_SYSTEM_LINUX) || defined(SFML_SYSTEM_FREEBSD) || defined(SFML_SYSTEM_OPENBSD) || defined(SFML_SYSTEM_NETBSD)
+#include <X11/Xlib.h>
+#define WINDOW_WAKER_X11
+#endif
+
+WindowWaker::WindowWaker(sf::WindowHandle window) : window(window), display(nullptr) {
+#ifdef WINDOW_WAKER_X11
+    display = XOpenDisplay(nullptr);
+#endif
+}
+
+WindowWaker::~WindowWaker() {
+#ifdef WINDOW_WAKER_X11
+    if (display) {
+        XCloseDisplay(static_cast<Display *>(display));
+    }
+#endif
+}
+
+void WindowWaker::wake() {
+    lock_guard<mutex> guard(lock);
+#if defined(SFML_SYSTEM_WINDOWS)
+    PostMessage(window, WM_SETFOCUS, 0, 0);
+#elif defined(WINDOW_WAKER_X11)
+    if (!display) {
+        return;
+    }
+
+    // SFML turns an EnterNotify of the normal mode into sf::Event::MouseEntered
+    Display *connection = static_cast<Display *>(display);
+    XEvent event{};
+    event.xcrossing.type = EnterNotify;
+    event.xcrossing.display = connection;
+    event.xcrossing.window = window;
+    event.xcrossing.mode = NotifyNormal;
+    XSendEvent(connection, window, False, EnterWindowMask, &event);
+    XFlush(connection);
+#endif
+}
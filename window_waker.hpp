@@ -0,0 +1,44 @@
+// noavrd@gmail.com
+
+#ifndef WINDOW_WAKER_HPP
+#define WINDOW_WAKER_HPP
+
+#include <mutex>
+#include <SFML/Window.hpp>
+
+using namespace std;
+
+/**
+ * WindowWaker class
+ *
+ * Wakes a window that sleeps in waitEvent, from any thread: SFML has no event of its own to post,
+ * so it sends the window a system event that SFML turns into an sf::Event (MouseEntered on X11, GainedFocus on Windows).
+ * On X11 it uses its own connection to the display, so it does not touch the one SFML reads events from.
+ * On the other systems wake() does nothing and the window only wakes for its own events.
+ *
+ * It is built in window_waker.cpp, so the system headers (and the macros of Xlib) stay out of the other files.
+ */
+class WindowWaker {
+private:
+    sf::WindowHandle window;
+    void *display; // The X11 connection, nullptr on the other systems
+    mutex lock;    // wake() can be called from several threads
+
+public:
+    /**
+     * @param window The handle of the window to wake, like sf::Window::getSystemHandle gives
+     */
+    explicit WindowWaker(sf::WindowHandle window);
+
+    WindowWaker(const WindowWaker &) = delete;
+    WindowWaker &operator=(const WindowWaker &) = delete;
+
+    ~WindowWaker();
+
+    /**
+     * Makes the window's waitEvent return with an event
+     */
+    void wake();
+};
+
+#endif // WINDOW_WAKER_HPP